@@ -339,16 +339,9 @@ int UserDel(char *name, struct acluser **up)
  */
 int UserFreeCopyBuffer(struct acluser *u)
 {
-	Window *w;
-	struct paster *pa;
-
 	if (!u->u_plop.buf)
 		return -1;
-	for (w = windows; w; w = w->w_next) {
-		pa = &w->w_paster;
-		if (pa->pa_pasteptr >= u->u_plop.buf && pa->pa_pasteptr - u->u_plop.buf < (ptrdiff_t)u->u_plop.len)
-			FreePaster(pa);
-	}
+	KillPasters(u->u_plop.buf, u->u_plop.len);
 	free((char *)u->u_plop.buf);
 	u->u_plop.len = 0;
 	u->u_plop.buf = 0;
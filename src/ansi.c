@@ -43,6 +43,7 @@
 #include "mark.h"
 #include "misc.h"
 #include "process.h"
+#include "record.h"
 #include "resize.h"
 #include "winmsg.h"
 
@@ -62,6 +63,7 @@ uint32_t *null;			/* line filled with '\0' */
 struct mline mline_old;
 struct mline mline_blank;
 struct mline mline_null;
+uint32_t mline_gen;		/* last generation given to a line */
 
 struct mchar mchar_null;
 struct mchar mchar_blank = { ' ', 0, 0, 0, 0, 0, 0 };
@@ -137,6 +139,7 @@ static void Report(Window *, char *, int, int);
 static void ScrollRegion(Window *win, int);
 static void WAddLineToHist(Window *, struct mline *);
 static void WLogString(Window *, char *, size_t);
+static void WLogLine(Window *, struct mline *);
 static void WReverseVideo(Window *, bool);
 static void MFixLine(Window *, int, struct mchar *);
 static void MScrollH(Window *, int, int, int, int, int);
@@ -219,8 +222,10 @@ void WriteString(Window *win, char *buf, size_t len)
 
 	if (len == 0)
 		return;
-	if (win->w_log)
+	if (win->w_log && log_text == LOG_TEXT_OFF)
 		WLogString(win, buf, len);
+	if (win->w_rec)
+		RecordOutput(win, buf, len);
 
 	if (win->w_silence)
 		SetTimeout(&win->w_silenceev, win->w_silencewait * 1000);
@@ -524,6 +529,7 @@ void WriteString(Window *win, char *buf, size_t len)
 						utf8_handle_comb(c, &omc);
 						MFixLine(win, oy, &omc);
 						copy_mchar2mline(&omc, &win->w_mlines[oy], ox);
+						touch_mline(&win->w_mlines[oy]);
 						LPutChar(&win->w_layer, &omc, ox, oy);
 						LGotoPos(&win->w_layer, win->w_x, win->w_y);
 					}
@@ -660,6 +666,8 @@ static void WLogString(Window *win, char *buf, size_t len)
 {
 	if (!win->w_log)
 		return;
+	if (logfrotatedue(win->w_log) && RotateLog(win))
+		return;
 	if (logtstamp_on && win->w_logsilence >= logtstamp_after * 2) {
 		char *t = MakeWinMsg(logtstamp_string, win, '%');
 		logfwrite(win->w_log, t, strlen(t));	/* long time no write */
@@ -674,6 +682,55 @@ static void WLogString(Window *win, char *buf, size_t len)
 		logfflush(win->w_log);
 }
 
+/* log the text of a line leaving the screen, trailing blanks trimmed */
+static void WLogLine(Window *win, struct mline *ml)
+{
+	static char *buf;
+	static size_t buflen;
+	size_t l = 0, need = win->w_width * 9 + 64;
+	time_t now;
+	int k, n;
+
+	if (logfrotatedue(win->w_log) && RotateLog(win))
+		return;
+	if (need > buflen) {
+		char *nbuf = realloc(buf, need);
+		if (!nbuf)
+			return;
+		buf = nbuf;
+		buflen = need;
+	}
+	if (log_text == LOG_TEXT_STAMP) {
+		(void)time(&now);
+		l = strftime(buf, buflen, "%Y-%m-%d %H:%M:%S ", localtime(&now));
+	}
+	k = FindNotEq32Rev(ml->image, ' ', win->w_width);
+	for (int x = 0; x <= k; x++) {
+		if (ml->image[x] == 0xff && ml->font[x] == 0xff)
+			continue;	/* right half of a double width char */
+		if ((n = EncodeChar(buf + l, ml->image[x], win->w_encoding, NULL)) > 0)
+			l += n;
+	}
+	buf[l++] = '\n';
+	win->w_logsilence = 0;
+	if (logfwrite(win->w_log, buf, l) < 1) {
+		WMsg(win, errno, "Error writing logfile");
+		logfclose(win->w_log);
+		win->w_log = 0;
+	}
+	if (win->w_log && !log_flush)
+		logfflush(win->w_log);
+}
+
+/* the log ends: write the text of the lines still on the screen */
+void WLogScreen(Window *win)
+{
+	if (!win->w_log || log_text == LOG_TEXT_OFF || !win->w_mlines)
+		return;
+	for (int y = 0, n = MFindUsedLine(win, win->w_height - 1, 0); y <= n && win->w_log; y++)
+		WLogLine(win, &win->w_mlines[y]);
+}
+
 static int Special(Window *win, int c)
 {
 	switch (c) {
@@ -1299,7 +1356,8 @@ static int StringEnd(Window *win)
 		}
 		return -1;
 	case DCS:
-		LAY_DISPLAYS(&win->w_layer, AddStr(win->w_string));
+		/* the terminal may do anything with it, forget what is shown */
+		LAY_DISPLAYS(&win->w_layer, AddStr(win->w_string); InvalidateLineHashes());
 		break;
 	case AKA:
 		if (win->w_title == win->w_akabuf && !*win->w_string)
@@ -1778,6 +1836,7 @@ static void FillWithEs(Window *win)
 		ep = p + win->w_width;
 		while (p < ep)
 			*p++ = 'E';
+		touch_mline(&win->w_mlines[i]);
 	}
 	LRefreshAll(&win->w_layer, 1);
 }
@@ -1867,7 +1926,7 @@ static void Report(Window *win, char *fmt, int n1, int n2)
 	len = strlen(rbuf);
 
 	if (W_UWP(win)) {
-		if ((unsigned)(win->w_pwin->p_inlen + len) <= sizeof(win->w_pwin->p_inbuf)) {
+		if ((unsigned)(win->w_pwin->p_inlen + len) <= win->w_pwin->p_insize) {
 			memmove(win->w_pwin->p_inbuf + win->w_pwin->p_inlen, rbuf, len);
 			win->w_pwin->p_inlen += len;
 		}
@@ -1955,6 +2014,7 @@ static void MScrollH(Window *win, int n, int y, int xs, int xe, int bce)
 	if (n == 0)
 		return;
 	ml = &win->w_mlines[y];
+	touch_mline(ml);
 	MKillDwRight(win, ml, xs);
 	MKillDwLeft(win, ml, xe);
 	if (n > 0) {
@@ -2022,6 +2082,7 @@ static void MScrollV(Window *win, int n, int ys, int ye, int bce)
 				free(ml->colorfg);
 			ml->colorfg = null;
 			memmove(ml->image, blank, (win->w_width + 1) * 4);
+			touch_mline(ml);
 			if (bce)
 				MBceLine(win, i, 0, win->w_width, bce);
 		}
@@ -2058,6 +2119,7 @@ static void MScrollV(Window *win, int n, int ys, int ye, int bce)
 				free(ml->colorfg);
 			ml->colorfg = null;
 			memmove(ml->image, blank, (win->w_width + 1) * 4);
+			touch_mline(ml);
 			if (bce)
 				MBceLine(win, i, 0, win->w_width, bce);
 		}
@@ -2104,6 +2166,7 @@ static void MClearArea(Window *win, int xs, int ys, int xe, int ye, int bce)
 
 	ml = win->w_mlines + ys;
 	for (int y = ys; y <= ye; y++, ml++) {
+		touch_mline(ml);
 		xxe = (y == ye) ? xe : win->w_width - 1;
 		n = xxe - xs + 1;
 		if (n > 0)
@@ -2121,6 +2184,7 @@ static void MInsChar(Window *win, struct mchar *c, int x, int y)
 
 	MFixLine(win, y, c);
 	ml = win->w_mlines + y;
+	touch_mline(ml);
 	n = win->w_width - x - 1;
 	MKillDwRight(win, ml, x);
 	if (n > 0) {
@@ -2150,6 +2214,7 @@ static void MPutChar(Window *win, struct mchar *c, int x, int y)
 
 	MFixLine(win, y, c);
 	ml = &win->w_mlines[y];
+	touch_mline(ml);
 	MKillDwRight(win, ml, x);
 	MKillDwLeft(win, ml, x);
 	copy_mchar2mline(c, ml, x);
@@ -2175,6 +2240,7 @@ static void MWrapChar(Window *win, struct mchar *c, int y, int top, int bot, boo
 	MFixLine(win, y, c);
 	ml = &win->w_mlines[y];
 	copy_mchar2mline(&mchar_null, ml, win->w_width);
+	touch_mline(ml);
 	if (y == bot)
 		MScrollV(win, 1, top, bot, bce);
 	else if (y < win->w_height - 1)
@@ -2194,6 +2260,7 @@ static void MBceLine(Window *win, int y, int xs, int xe, int bce)
 	mc.colorbg = bce;
 	MFixLine(win, y, &mc);
 	ml = win->w_mlines + y;
+	touch_mline(ml);
 	if (mc.attr)
 		for (int x = xs; x <= xe; x++)
 			ml->attr[x] = mc.attr;
@@ -2210,12 +2277,20 @@ static void WAddLineToHist(Window *win, struct mline *ml)
 	uint32_t *q, *o;
 	struct mline *hml;
 
+	if (win->w_log && log_text != LOG_TEXT_OFF)
+		WLogLine(win, ml);
 	if (win->w_histheight == 0)
 		return;
+	if (win->w_hardcopies)
+		HardcopyKeep(win);
 	hml = &win->w_hlines[win->w_histidx];
+	touch_mline(ml);
+	touch_mline(hml);
 	q = ml->image;
 	ml->image = hml->image;
 	hml->image = q;
+	hml->bloom = CellBloom(hml->image, win->w_width);
+	hml->bloomgen = hml->gen;
 
 	q = ml->attr;
 	o = hml->attr;
@@ -2250,6 +2325,7 @@ static void WAddLineToHist(Window *win, struct mline *ml)
 
 	if (++win->w_histidx >= win->w_histheight)
 		win->w_histidx = 0;
+	win->w_histcount++;
 }
 
 int MFindUsedLine(Window *win, int ye, int ys)
@@ -2258,13 +2334,13 @@ int MFindUsedLine(Window *win, int ye, int ys)
 	struct mline *ml = win->w_mlines + ye;
 
 	for (y = ye; y >= ys; y--, ml--) {
-		if (memcmp(ml->image, blank, win->w_width * 4))
+		if (FindNotEq32(ml->image, ' ', win->w_width) < win->w_width)
 			break;
-		if (ml->attr != null && memcmp(ml->attr, null, win->w_width * 4))
+		if (ml->attr != null && FindNotEq32(ml->attr, 0, win->w_width) < win->w_width)
 			break;
-		if (ml->colorbg != null && memcmp(ml->colorbg, null, win->w_width * 4))
+		if (ml->colorbg != null && FindNotEq32(ml->colorbg, 0, win->w_width) < win->w_width)
 			break;
-		if (ml->colorfg != null && memcmp(ml->colorfg, null, win->w_width * 4))
+		if (ml->colorfg != null && FindNotEq32(ml->colorfg, 0, win->w_width) < win->w_width)
 			break;
 		if (win->w_encoding == UTF8) {
 			if (ml->font != null && memcmp(ml->font, null, win->w_width))
@@ -158,6 +158,7 @@ int   GetAnsiStatus (Window *, char *);
 void  WNewAutoFlow (Window *, int);
 void  WBell (Window *, bool);
 void  WMsg (Window *, int, char *);
+void  WLogScreen (Window *);
 int   MFindUsedLine (Window *, int, int);
 
 /* global variables */
@@ -179,6 +180,7 @@ extern const int Z1width;
 extern struct mline mline_blank;
 extern struct mline mline_null;
 extern struct mline mline_old;
+extern uint32_t mline_gen;
 
 extern struct mchar mchar_so;
 extern struct mchar mchar_blank;
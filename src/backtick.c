@@ -31,14 +31,47 @@
  ****************************************************************
  */
 
+#include "config.h"
+
 #include "backtick.h"
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "fileio.h"
+#include "misc.h"
 #include "winmsg.h"
 
 /* TODO: get rid of global var */
 Backtick *backticks;
 
+/*
+ * Providers computed in-process instead of running a command, picked
+ * by a command name starting with ':'.
+ */
+struct bt_builtin {
+	char *name;
+	int nargs;		/* required arguments */
+	bool perwin;		/* result depends on the window */
+	void (*fn)(Backtick *, Window *, time_t);
+};
+
+static void bt_file(Backtick *, Window *, time_t);
+static void bt_loadavg(Backtick *, Window *, time_t);
+static void bt_meminfo(Backtick *, Window *, time_t);
+static void bt_rate(Backtick *, Window *, time_t);
+static void bt_strftime(Backtick *, Window *, time_t);
+
+static const struct bt_builtin bt_builtins[] = {
+	{ ":file",	1, false, bt_file },
+	{ ":loadavg",	0, false, bt_loadavg },
+	{ ":meminfo",	0, false, bt_meminfo },
+	{ ":rate",	0, true,  bt_rate },
+	{ ":strftime",	1, false, bt_strftime },
+};
+
 static void backtick_filter(struct backtick *bt)
 {
 	char *p, *q;
@@ -53,9 +86,171 @@ static void backtick_filter(struct backtick *bt)
 	*q = 0;
 }
 
+/* keep the last line read from f in bt->result */
+static void readlastline(Backtick *bt, int f)
+{
+	int i, l, j;
+
+	i = 0;
+	while ((l = read(f, bt->result + i, sizeof(bt->result) - i)) > 0) {
+		i += l;
+		for (j = 1; j < l; j++)
+			if (bt->result[i - j - 1] == '\n')
+				break;
+		if (j == l && i == sizeof(bt->result)) {
+			j = sizeof(bt->result) / 2;
+			l = j + 1;
+		}
+		if (j < l) {
+			memmove(bt->result, bt->result + i - j, j);
+			i = j;
+		}
+	}
+	bt->result[sizeof(bt->result) - 1] = '\n';
+	if (i && bt->result[i - 1] == '\n')
+		i--;
+	bt->result[i] = 0;
+}
+
+/* n with a binary unit suffix, like 1.5M */
+static void bt_size(char *buf, size_t len, uint64_t n)
+{
+	static const char units[] = "KMGTPE";
+	double d = n;
+	int u = -1;
+
+	while (d >= 1024 && units[u + 1]) {
+		d /= 1024;
+		u++;
+	}
+	if (u < 0)
+		snprintf(buf, len, "%" PRIu64, n);
+	else
+		snprintf(buf, len, "%.1f%c", d, units[u]);
+}
+
+/* last line of a file, only read again when the file changed */
+static void bt_file(Backtick *bt, Window *win, time_t now)
+{
+	struct stat st;
+	int f;
+
+	(void)win; /* unused */
+	(void)now; /* unused */
+	if (stat(bt->cmdv[1], &st)) {
+		memset(&bt->st, 0, sizeof(bt->st));
+		bt->result[0] = 0;
+		return;
+	}
+	if (st.st_dev == bt->st.st_dev && st.st_ino == bt->st.st_ino && st.st_size == bt->st.st_size
+	    && st.st_mtime == bt->st.st_mtime && st.st_ctime == bt->st.st_ctime)
+		return;
+	if ((f = open(bt->cmdv[1], O_RDONLY)) == -1) {
+		bt->result[0] = 0;
+		return;
+	}
+	/* the last line is all we want */
+	if (S_ISREG(st.st_mode) && st.st_size > (off_t)sizeof(bt->result))
+		lseek(f, st.st_size - sizeof(bt->result), SEEK_SET);
+	readlastline(bt, f);
+	close(f);
+	bt->st = st;
+}
+
+static void bt_loadavg(Backtick *bt, Window *win, time_t now)
+{
+	double av[3];
+
+	(void)win; /* unused */
+	(void)now; /* unused */
+	if (getloadavg(av, 3) == 3)
+		snprintf(bt->result, sizeof(bt->result), "%.2f %.2f %.2f", av[0], av[1], av[2]);
+	else
+		bt->result[0] = 0;
+}
+
+/* used/total memory, from /proc/meminfo */
+static void bt_meminfo(Backtick *bt, Window *win, time_t now)
+{
+	FILE *f;
+	char line[256], used[16], total[16];
+	unsigned long long v, memtotal = 0, memavail = 0;
+
+	(void)win; /* unused */
+	(void)now; /* unused */
+	bt->result[0] = 0;
+	if (!(f = fopen("/proc/meminfo", "r")))
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "MemTotal: %llu", &v) == 1)
+			memtotal = v;
+		else if (sscanf(line, "MemAvailable: %llu", &v) == 1)
+			memavail = v;
+	}
+	fclose(f);
+	if (!memtotal || memavail > memtotal)
+		return;
+	bt_size(used, sizeof(used), (uint64_t)(memtotal - memavail) * 1024);
+	bt_size(total, sizeof(total), (uint64_t)memtotal * 1024);
+	snprintf(bt->result, sizeof(bt->result), "%s/%s", used, total);
+}
+
+/* bytes per second the window's program writes */
+static void bt_rate(Backtick *bt, Window *win, time_t now)
+{
+	char buf[16];
+
+	bt->result[0] = 0;
+	if (!win)
+		return;
+	if (now > win->w_ratetime) {
+		if (win->w_ratetime)
+			win->w_rate = (win->w_readbytes - win->w_ratebytes) / (now - win->w_ratetime);
+		win->w_ratebytes = win->w_readbytes;
+		win->w_ratetime = now;
+	}
+	bt_size(buf, sizeof(buf), win->w_rate);
+	snprintf(bt->result, sizeof(bt->result), "%s/s", buf);
+}
+
+/* the time formatted by strftime(), in the given time zone if any */
+static void bt_strftime(Backtick *bt, Window *win, time_t now)
+{
+	char *tz = bt->cmdv[2], *otz = NULL;
+	struct tm *tm;
+
+	(void)win; /* unused */
+	if (tz) {
+		if ((otz = getenv("TZ")))
+			otz = SaveStr(otz);
+		setenv("TZ", tz, 1);
+		tzset();
+	}
+	if (!(tm = localtime(&now)) || !strftime(bt->result, sizeof(bt->result), bt->cmdv[1], tm))
+		bt->result[0] = 0;
+	if (tz) {
+		if (otz) {
+			setenv("TZ", otz, 1);
+			free(otz);
+		} else
+			unsetenv("TZ");
+		tzset();
+	}
+}
+
+/* does some result use backticks itself? Then any of them may show up anywhere. */
+static bool backtick_nested(void)
+{
+	for (Backtick *bt = backticks; bt; bt = bt->next)
+		if (strchr(bt->result, WINESC_BACKTICK))
+			return true;
+	return false;
+}
+
 static void backtick_fn(Event *ev, void *data)
 {
 	struct backtick *bt;
+	char old[MAXSTR];
 	int i, j, k, l;
 
 	bt = (struct backtick *)data;
@@ -76,10 +271,16 @@ static void backtick_fn(Event *ev, void *data)
 			if (bt->buf[k] == '\n')
 				break;
 		k++;
+		memcpy(old, bt->result, sizeof(old));
 		memmove(bt->result, bt->buf + k, i - j - k);
 		bt->result[i - j - k - 1] = 0;
 		backtick_filter(bt);
-		WindowChanged(0, WINESC_BACKTICK);
+		if (strcmp(old, bt->result)) {
+			if (backtick_nested())
+				WindowChanged(0, WINESC_BACKTICK);
+			else
+				WinMsgBacktickChanged(bt->num);
+		}
 	}
 	if (j == l && i == MAXSTR) {
 		j = MAXSTR / 2;
@@ -96,7 +297,26 @@ static void backtick_fn(Event *ev, void *data)
 void setbacktick(int num, int lifespan, int tick, char **cmdv)
 {
 	struct backtick **btp, *bt;
+	const struct bt_builtin *builtin = NULL;
 	char **v;
+	int n;
+
+	if (cmdv && **cmdv == ':') {
+		for (n = 0; cmdv[n]; n++) ;
+		for (size_t i = 0; i < sizeof(bt_builtins) / sizeof(*bt_builtins); i++)
+			if (!strcmp(*cmdv, bt_builtins[i].name))
+				builtin = bt_builtins + i;
+		if (!builtin || n - 1 < builtin->nargs) {
+			if (builtin)
+				Msg(0, "%s: backtick provider needs %d argument%s", *cmdv, builtin->nargs, builtin->nargs == 1 ? "" : "s");
+			else
+				Msg(0, "%s: unknown backtick provider", *cmdv);
+			for (v = cmdv; *v; v++)
+				free(*v);
+			free(cmdv);
+			return;
+		}
+	}
 
 	for (btp = &backticks; (bt = *btp) != 0; btp = &bt->next)
 		if (bt->num == num)
@@ -136,8 +356,10 @@ void setbacktick(int num, int lifespan, int tick, char **cmdv)
 	bt->buf = 0;
 	bt->bufi = 0;
 	bt->cmdv = cmdv;
+	bt->builtin = builtin;
+	memset(&bt->st, 0, sizeof(bt->st));
 	bt->ev.fd = -1;
-	if (bt->tick == 0 && bt->lifespan == 0) {
+	if (bt->tick == 0 && bt->lifespan == 0 && !builtin) {
 		bt->buf = malloc(MAXSTR);
 		if (bt->buf == 0) {
 			Msg(0, "%s", strnomem);
@@ -153,39 +375,29 @@ void setbacktick(int num, int lifespan, int tick, char **cmdv)
 	}
 }
 
-char *runbacktick(Backtick *bt, int *tickp, time_t now)
+char *runbacktick(Backtick *bt, int *tickp, time_t now, Window *win)
 {
-	int f, i, l, j;
+	int f;
 	time_t now2;
 
 	if (bt->tick && (!*tickp || bt->tick < *tickp))
 		*tickp = bt->tick;
+	if (bt->builtin) {
+		if (bt->builtin->perwin || now >= bt->bestbefore) {
+			bt->builtin->fn(bt, win, now);
+			backtick_filter(bt);
+			bt->bestbefore = now + bt->lifespan;
+		}
+		return bt->result;
+	}
 	if ((bt->lifespan == 0 && bt->tick == 0) || now < bt->bestbefore) {
 		return bt->result;
 	}
 	f = readpipe(bt->cmdv);
 	if (f == -1)
 		return bt->result;
-	i = 0;
-	while ((l = read(f, bt->result + i, sizeof(bt->result) - i)) > 0) {
-		i += l;
-		for (j = 1; j < l; j++)
-			if (bt->result[i - j - 1] == '\n')
-				break;
-		if (j == l && i == sizeof(bt->result)) {
-			j = sizeof(bt->result) / 2;
-			l = j + 1;
-		}
-		if (j < l) {
-			memmove(bt->result, bt->result + i - j, j);
-			i = j;
-		}
-	}
+	readlastline(bt, f);
 	close(f);
-	bt->result[sizeof(bt->result) - 1] = '\n';
-	if (i && bt->result[i - 1] == '\n')
-		i--;
-	bt->result[i] = 0;
 	backtick_filter(bt);
 	(void)time(&now2);
 	bt->bestbefore = now2 + bt->lifespan;
@@ -34,9 +34,12 @@
 #ifndef SCREEN_BACKTICK_H
 #define SCREEN_BACKTICK_H
 
+#include <sys/stat.h>
 #include <time.h>
 #include "screen.h"
 
+struct bt_builtin;
+
 typedef struct backtick {
 	struct backtick *next;
 	int num;
@@ -48,11 +51,13 @@ typedef struct backtick {
 	Event ev;
 	char *buf;
 	int bufi;
+	const struct bt_builtin *builtin;	/* in-process provider instead of cmdv */
+	struct stat st;		/* file last read by the :file provider */
 } Backtick;
 
 /* TODO: these still need refactoring */
 void setbacktick(int, int, int, char **);
-char *runbacktick(Backtick *bt, int *tickp, time_t now);
+char *runbacktick(Backtick *bt, int *tickp, time_t now, Window *win);
 
 /* opaque interface */
 Backtick *bt_find_id(int);
@@ -67,6 +67,7 @@ struct Canvas {
 	int              c_ys;
 	int              c_ye;
 	Event     c_captev;		/* caption changed event */
+	int       c_msgdirty;		/* caption/windowlist redraw pending */
 };
 
 void  SetCanvasWindow (Canvas *, Window *);
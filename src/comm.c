@@ -118,6 +118,7 @@ struct comm comms[RC_LAST + 1] =
   { "focus",		NEED_DISPLAY|ARGS_01,		{NULL} },
   { "focusminsize",	ARGS_02,			{NULL} },
   { "gr",		NEED_FORE|ARGS_01,		{NULL} },
+  { "grep",		NEED_LAYER|ARGS_01,		{NULL} },
   { "group",            NEED_FORE|ARGS_01,		{NULL} },
   { "hardcopy",		NEED_FORE|ARGS_012,		{NULL} },
   { "hardcopy_append",	ARGS_1,				{NULL} },
@@ -126,6 +127,7 @@ struct comm comms[RC_LAST + 1] =
   { "height",		ARGS_0123,			{NULL} },
   { "help",		NEED_LAYER|ARGS_02,		{NULL} },
   { "history",		NEED_DISPLAY|NEED_FORE|ARGS_0,	{NULL} },
+  { "hlsearch",		ARGS_01,			{NULL} },
   { "hstatus",		NEED_FORE|ARGS_1,		{NULL} },
   { "idle",		ARGS_0|ARGS_ORMORE,		{NULL} },
   { "ignorecase",	ARGS_01,			{NULL} },
@@ -172,7 +174,10 @@ struct comm comms[RC_LAST + 1] =
   { "quit",		ARGS_0,				{NULL} },
   { "readbuf",		ARGS_0123,			{NULL} },
   { "readreg",          ARGS_0|ARGS_ORMORE,		{NULL} },
+  { "record",		NEED_FORE|ARGS_01,		{NULL} },
+  { "recordfile",	ARGS_01,			{NULL} },
   { "redisplay",	NEED_DISPLAY|ARGS_0,		{NULL} },
+  { "regexsearch",	ARGS_01,			{NULL} },
   { "register",		ARGS_24,			{NULL} },
   { "remove",		NEED_DISPLAY|ARGS_0,		{NULL} },
   { "removebuf",	ARGS_0,				{NULL} },
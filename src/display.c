@@ -68,6 +68,21 @@ static void INSERTCHAR(int);
 static void RAW_PUTCHAR(int);
 static void SetBackColor(int);
 static void RemoveStatusMinWait(void);
+static void InvalLineHash(int, int);
+static void ShiftLineHash(int, int, int);
+static uint32_t DisplayRowHash(int);
+static void SaveLineHashes(void);
+static bool RefreshAllHashed(void);
+static bool CheckLineHashes(void);
+static void FreeStatusLines(void);
+static bool PutStatusLine(char *, int, bool);
+static bool RefreshCaptionLine(int, int, int);
+
+/* forget what is shown on display line y */
+#define INVAL_LHASH(y) do {						\
+	if (D_lhash && (y) >= 0 && (y) < D_lhashlen)			\
+		D_lhash[y] = 0;						\
+} while (0)
 
 Display *display, *displays;
 
@@ -270,6 +285,9 @@ void FreeDisplay()
 		free(D_status_lastmsg);
 	if (D_obuf)
 		free(D_obuf);
+	if (D_lhash)
+		free(D_lhash);
+	FreeStatusLines();
 	*dp = display->d_next;
 
 	while (D_canvas.c_slperp)
@@ -419,7 +437,7 @@ void PUTCHARLP(int c)
 
 static void RAW_PUTCHAR(int c)
 {
-
+	INVAL_LHASH(D_y);
 	if (D_encoding == UTF8) {
 		c = (c & 255) | (unsigned char)D_rend.font << 8 | (unsigned char)D_rend.fontx << 16;
 		if (D_mbcs) {
@@ -822,6 +840,7 @@ void ClearArea(int x1, int y1, int xs, int xe, int x2, int y2, int bce, int usel
 		xs = x1;
 	if (xe == -1)
 		xe = x2;
+	InvalLineHash(y1, y2);
 	if (D_UT)		/* Safe to erase ? */
 		SetRendition(&mchar_null);
 	if (D_BE)
@@ -899,6 +918,219 @@ void ClearArea(int x1, int y1, int xs, int xe, int x2, int y2, int bce, int usel
 	}
 }
 
+/*
+ * Line hashes.
+ *
+ * For every display line we remember a hash of the window line that
+ * was last drawn there completely (0 if the content is unknown). All
+ * output that modifies a line forgets its hash, scrolling the display
+ * moves the hashes along. When the display is redrawn, lines that
+ * already show the right content are skipped, and if most lines just
+ * moved up or down the terminal is scrolled before the rest is patched.
+ */
+
+void InvalidateLineHashes()
+{
+	if (display && D_lhash)
+		InvalLineHash(0, D_lhashlen - 1);
+}
+
+static void InvalLineHash(int ys, int ye)
+{
+	if (!D_lhash)
+		return;
+	if (ys < 0)
+		ys = 0;
+	if (ye >= D_lhashlen)
+		ye = D_lhashlen - 1;
+	for (; ys <= ye; ys++)
+		D_lhash[ys] = 0;
+}
+
+/* lines ys..ye were scrolled up by n (down if n < 0) */
+static void ShiftLineHash(int ys, int ye, int n)
+{
+	if (!D_lhash || ys < 0 || ye >= D_lhashlen || ys > ye)
+		return;
+	if (n >= ye - ys + 1 || -n >= ye - ys + 1) {
+		InvalLineHash(ys, ye);
+		return;
+	}
+	if (n > 0) {
+		memmove(D_lhash + ys, D_lhash + ys + n, (ye - ys + 1 - n) * sizeof(uint32_t));
+		InvalLineHash(ye - n + 1, ye);
+	} else if (n < 0) {
+		memmove(D_lhash + ys - n, D_lhash + ys, (ye - ys + 1 + n) * sizeof(uint32_t));
+		InvalLineHash(ys, ys - n - 1);
+	}
+}
+
+uint32_t HashMline(struct mline *ml, int n)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a, one step per cell and plane */
+
+	if (ml->gen && ml->hashgen == ml->gen && ml->hashlen == n)
+		return ml->hash;
+	for (int x = 0; x < n; x++) {
+		h = (h ^ ml->image[x]) * 16777619u;
+		h = (h ^ ml->attr[x]) * 16777619u;
+		h = (h ^ ml->font[x]) * 16777619u;
+		h = (h ^ ml->fontx[x]) * 16777619u;
+		h = (h ^ ml->colorbg[x]) * 16777619u;
+		h = (h ^ ml->colorfg[x]) * 16777619u;
+	}
+	ml->hash = h;
+	ml->hashgen = ml->gen;
+	ml->hashlen = n;
+	return h;
+}
+
+/*
+ * Hash of what a full refresh would draw on line y, 0 if it can't be
+ * told without drawing. Only lines that consist of a single window line
+ * spanning the whole display width are hashed.
+ */
+static uint32_t DisplayRowHash(int y)
+{
+	Canvas *cv;
+	Viewport *vp;
+	Layer *l;
+	Window *p;
+	uint32_t h;
+
+	for (cv = D_cvlist; cv; cv = cv->c_next)
+		if (y >= cv->c_ys && y <= cv->c_ye)
+			break;
+	if (!cv || cv->c_xs != 0 || cv->c_xe != D_width - 1)
+		return 0;
+	vp = cv->c_vplist;
+	if (!vp || vp->v_next || vp->v_xoff != 0 || vp->v_xs != 0 || vp->v_xe != D_width - 1)
+		return 0;
+	l = cv->c_layer;
+	if (!l || l->l_layfn != &WinLf || l->l_width != D_width)
+		return 0;
+	y -= vp->v_yoff;
+	if (y < 0 || y >= l->l_height)
+		return 0;
+	p = (Window *)l->l_data;
+	h = HashMline(&p->w_mlines[y], l->l_width) ^ (uint32_t)l->l_encoding;
+	h &= ~1u;	/* odd values mark status lines */
+	return h ? h : 2;
+}
+
+/* make sure D_lhash matches the display size */
+static bool CheckLineHashes(void)
+{
+	if (D_lhash && D_lhashlen == D_height && D_lhashwidth == D_width)
+		return true;
+	if (D_lhash)
+		free(D_lhash);
+	D_lhash = calloc(D_height, sizeof(uint32_t));
+	D_lhashlen = D_lhash ? D_height : 0;
+	D_lhashwidth = D_width;
+	return false;
+}
+
+/* remember the hashes after a full refresh */
+static void SaveLineHashes(void)
+{
+	uint32_t h;
+
+	CheckLineHashes();
+	for (int y = 0; y < D_lhashlen; y++) {
+		h = (y == D_bot && D_lp_missing) ? 0 : DisplayRowHash(y);
+		if (h || !(D_lhash[y] & 1))	/* keep status line stamps */
+			D_lhash[y] = h;
+	}
+}
+
+/*
+ * Find the vertical shift of lines ys..ye that makes most of the old
+ * lines match the new hashes nh. Returns the shift (positive: scroll
+ * up) and the number of matching lines in *cntp.
+ */
+static int BestLineShift(uint32_t *nh, int ys, int ye, int *cntp)
+{
+	int m, s, up, down, cnt0, best, bestcnt;
+
+	m = ye - ys + 1;
+	cnt0 = 0;
+	for (int y = ys; y <= ye; y++)
+		if (nh[y] && nh[y] == D_lhash[y])
+			cnt0++;
+	best = 0;
+	bestcnt = cnt0;
+	for (s = 1; s < m && m - s > bestcnt; s++) {
+		/* up: old line y + s moves to y, down: old line y moves to y + s */
+		up = down = 0;
+		for (int y = ys; y + s <= ye; y++) {
+			if (nh[y] && nh[y] == D_lhash[y + s])
+				up++;
+			if (nh[y + s] && nh[y + s] == D_lhash[y])
+				down++;
+		}
+		if (up > bestcnt || down > bestcnt) {
+			bestcnt = up > down ? up : down;
+			best = up > down ? s : -s;
+		}
+	}
+	/* scrolling costs a few bytes, so it must save at least two lines */
+	if (best && bestcnt <= cnt0 + 1) {
+		best = 0;
+		bestcnt = cnt0;
+	}
+	*cntp = bestcnt;
+	return best;
+}
+
+/*
+ * Refresh all of the display, reusing the lines that are already there.
+ * Returns false if too little of the display content can be reused, the
+ * caller has to clear the display and do a plain refresh then.
+ */
+static bool RefreshAllHashed(void)
+{
+	uint32_t *nh;
+	Canvas *cv;
+	int keep, cnt, shift;
+
+	if (!CheckLineHashes() || D_status || D_blocked)
+		return false;
+	if ((nh = malloc(D_height * sizeof(uint32_t))) == NULL)
+		return false;
+	for (int y = 0; y < D_height; y++)
+		nh[y] = DisplayRowHash(y);
+
+	/* repainting line by line is only worth it if enough lines are kept */
+	keep = 0;
+	for (cv = D_cvlist; cv; cv = cv->c_next)
+		if (nh[cv->c_ys]) {
+			BestLineShift(nh, cv->c_ys, cv->c_ye, &cnt);
+			keep += cnt;
+		}
+	if (keep * 4 < D_height) {
+		free(nh);
+		return false;
+	}
+	for (cv = D_cvlist; cv; cv = cv->c_next)
+		if (nh[cv->c_ys] && (shift = BestLineShift(nh, cv->c_ys, cv->c_ye, &cnt)) != 0) {
+			ScrollV(0, cv->c_ys, D_width - 1, cv->c_ye, shift, 0);
+			ChangeScrollRegion(0, D_height - 1);
+		}
+
+	for (cv = D_cvlist; cv; cv = cv->c_next) {
+		CV_CALL(cv, LayRedisplayLine(-1, -1, -1, 0));
+		display = cv->c_display;	/* just in case! */
+	}
+	for (int y = 0; y < D_height; y++) {
+		if (nh[y] && nh[y] == D_lhash[y] && !(y == D_bot && D_lp_missing))
+			continue;
+		RefreshLine(y, 0, D_width - 1, 0);
+	}
+	free(nh);
+	return true;
+}
+
 /*
  * if cur_only > 0, we only redisplay current line, as a full refresh is
  * too expensive over a low baud line.
@@ -917,13 +1149,19 @@ void Redisplay(int cur_only)
 	SetRendition(&mchar_null);
 	SetFlow(FLOW_ON);
 
-	ClearAll();
-	RefreshXtermOSC();
-	if (cur_only > 0 && D_fore)
-		RefreshArea(0, D_fore->w_y, D_width - 1, D_fore->w_y, 1);
-	else
-		RefreshAll(1);
+	if (cur_only == 0 && RefreshAllHashed()) {
+		RefreshXtermOSC();
+	} else {
+		ClearAll();
+		RefreshXtermOSC();
+		if (cur_only > 0 && D_fore)
+			RefreshArea(0, D_fore->w_y, D_width - 1, D_fore->w_y, 1);
+		else
+			RefreshAll(1);
+	}
 	RefreshHStatus();
+	if (cur_only <= 0)
+		SaveLineHashes();
 	CV_CALL(D_forecv, LayRestore();
 		LaySetCursor());
 }
@@ -945,6 +1183,7 @@ void ScrollH(int y, int xs, int xe, int n, int bce, struct mline *oml)
 
 	if (n == 0)
 		return;
+	INVAL_LHASH(y);
 	if (xe != D_width - 1) {
 		RefreshLine(y, xs, xe, 0);
 		/* UpdateLine(oml, y, xs, xe); */
@@ -1059,6 +1298,7 @@ void ScrollV(int xs, int ys, int xe, int ye, int n, int bce)
 	if (D_lp_missing && (oldbot != D_bot || (oldbot == D_bot && up && D_top == ys && D_bot == ye))) {
 		WriteLP(D_width - 1, oldbot);
 		if (oldbot == D_bot) {	/* have scrolled */
+			ShiftLineHash(D_top, D_bot, 1);
 			if (--n == 0) {
 /* XXX
 	      ChangeScrollRegion(oldtop, oldbot);
@@ -1108,6 +1348,7 @@ void ScrollV(int xs, int ys, int xe, int ye, int n, int bce)
 		RefreshArea(xs, ys, xe, ye, 0);
 		return;
 	}
+	ShiftLineHash(ys, ye, up ? n : -n);
 	if (bce && !D_BE) {
 		if (up)
 			ClearArea(xs, ye - n + 1, xs, xe, xe, ye, bce, 0);
@@ -1211,7 +1452,7 @@ void SetFont(int new)
 		AddCStr2(D_CS0, new);
 }
 
-int color256to16(int color)
+static int calc_color256to16(int color)
 {
 	int min, max;
 	int r, g, b;
@@ -1237,7 +1478,7 @@ int color256to16(int color)
 	return color;
 }
 
-int color256to88(int color)
+static int calc_color256to88(int color)
 {
 	int r, g, b;
 
@@ -1253,6 +1494,109 @@ int color256to88(int color)
 	return color;
 }
 
+/*
+ * Downsampling of the 256 color palette is done through tables that
+ * are filled once, so that redisplay on displays with fewer colors
+ * does not have to redo the arithmetic for every rendition change.
+ */
+static uint8_t color256to16tab[256];
+static uint8_t color256to88tab[256];
+static bool colortabs_initialized;
+
+static void InitColorTables(void)
+{
+	for (int i = 0; i < 256; i++) {
+		color256to16tab[i] = calc_color256to16(i);
+		color256to88tab[i] = calc_color256to88(i);
+	}
+	colortabs_initialized = true;
+}
+
+int color256to16(int color)
+{
+	if (!colortabs_initialized)
+		InitColorTables();
+	return color256to16tab[color & 0xff];
+}
+
+int color256to88(int color)
+{
+	if (!colortabs_initialized)
+		InitColorTables();
+	return color256to88tab[color & 0xff];
+}
+
+/*
+ * Truecolor to 256 color quantizer. The nearest entry of the xterm
+ * color cube or gray ramp is searched and remembered in a small direct
+ * mapped cache keyed on the rgb value. The 0x02000000 truecolor tag is
+ * kept in the key, so a zeroed slot never matches.
+ */
+#define RGBCACHE_SIZE 1024
+
+static struct rgbcache {
+	uint32_t rgb;
+	uint8_t color;
+} rgbcache[RGBCACHE_SIZE];
+
+static const uint8_t cubelevels[6] = { 0, 95, 135, 175, 215, 255 };
+
+static int nearest_cubelevel(int v)
+{
+	if (v < 48)
+		return 0;
+	if (v < 115)
+		return 1;
+	return (v - 35) / 40;
+}
+
+static int calc_truecolorto256(uint32_t rgb)
+{
+	int r, g, b;
+	int cr, cg, cb, gray, gv;
+	int dr, dg, db, dcube, dgray;
+
+	r = (rgb >> 16) & 0xff;
+	g = (rgb >> 8) & 0xff;
+	b = rgb & 0xff;
+
+	cr = nearest_cubelevel(r);
+	cg = nearest_cubelevel(g);
+	cb = nearest_cubelevel(b);
+	dr = r - cubelevels[cr];
+	dg = g - cubelevels[cg];
+	db = b - cubelevels[cb];
+	dcube = dr * dr + dg * dg + db * db;
+
+	/* gray ramp 232-255 covers levels 8, 18, ..., 238 */
+	gv = (r + g + b) / 3;
+	gray = gv < 8 ? 0 : (gv - 3) / 10;
+	if (gray > 23)
+		gray = 23;
+	gv = 8 + gray * 10;
+	dr = r - gv;
+	dg = g - gv;
+	db = b - gv;
+	dgray = dr * dr + dg * dg + db * db;
+
+	if (dgray < dcube)
+		return 232 + gray;
+	return 16 + cr * 36 + cg * 6 + cb;
+}
+
+static int truecolorto256(uint32_t rgb)
+{
+	struct rgbcache *rc;
+
+	rgb &= 0x02ffffff;
+	rc = &rgbcache[(rgb ^ (rgb >> 10) ^ (rgb >> 20)) & (RGBCACHE_SIZE - 1)];
+	if (rc->rgb != rgb) {
+		rc->rgb = rgb;
+		rc->color = calc_truecolorto256(rgb);
+	}
+	return rc->color;
+}
+
 /*
  * SetColor - Sets foreground and background color
  * 0x00000000 <- default color ("transparent")
@@ -1300,6 +1644,8 @@ void SetColor(uint32_t foreground, uint32_t background)
 	if (f != of && f == 0) {
 		AddCStr("\033[39m");	/* works because AX is set */
 	}
+	if (f != of && (f & 0x02000000) && !hastruecolor)
+		f = truecolorto256(f) | 0x01000000;
 	if (f != of && (f & 0x01000000)) {
 		f &= 0x0ff;
 		if (f > 15 && D_CCO != 256) {
@@ -1334,6 +1680,8 @@ void SetColor(uint32_t foreground, uint32_t background)
 	if (b != ob && b == 0) {
 		AddCStr("\033[49m");	/* works because AX is set */
 	}
+	if (b != ob && (b & 0x02000000) && !hastruecolor)
+		b = truecolorto256(b) | 0x01000000;
 	if (b != ob && (b & 0x01000000)) {
 		b &= 0x0ff;
 		if (b > 15 && D_CCO != 256) {
@@ -1463,6 +1811,7 @@ void MakeStatus(char *msg)
 	D_status_lasty = D_y;
 	if (!use_hardstatus || D_has_hstatus == HSTATUS_IGNORE || D_has_hstatus == HSTATUS_MESSAGE) {
 		D_status = STATUS_ON_WIN;
+		INVAL_LHASH(STATLINE());
 		GotoPos(STATCOL(D_width, D_status_len), STATLINE());
 		SetRendition(&mchar_so);
 		InsertMode(false);
@@ -1598,6 +1947,296 @@ static int PrePutWinMsg(char *s, int start, int max)
 	}
 }
 
+/*
+ * Status lines (captions and hardstatus) are kept as cells in
+ * D_slines, so a refresh only sends what changed. A line is known to
+ * be on the display as long as its odd stamp is still in D_lhash,
+ * anything else drawing there resets that.
+ */
+
+static struct mline sline_new;	/* line being built */
+static int sline_newlen;
+
+static void FreeSline(struct mline *ml)
+{
+	free(ml->image);
+	free(ml->attr);
+	free(ml->font);
+	free(ml->fontx);
+	free(ml->colorbg);
+	free(ml->colorfg);
+	memset(ml, 0, sizeof(struct mline));
+}
+
+static bool AllocSline(struct mline *ml, int n)
+{
+	ml->image = calloc(n, 4);
+	ml->attr = calloc(n, 4);
+	ml->font = calloc(n, 4);
+	ml->fontx = calloc(n, 4);
+	ml->colorbg = calloc(n, 4);
+	ml->colorfg = calloc(n, 4);
+	if (ml->image && ml->attr && ml->font && ml->fontx && ml->colorbg && ml->colorfg)
+		return true;
+	FreeSline(ml);
+	return false;
+}
+
+static void FreeStatusLines(void)
+{
+	for (int y = 0; y < D_slineslen; y++)
+		FreeSline(D_slines + y);
+	free(D_slines);
+	free(D_slinestamp);
+	D_slines = NULL;
+	D_slinestamp = NULL;
+	D_slineslen = 0;
+}
+
+/* cells of status line y as last drawn, *validp tells if still shown */
+static struct mline *StatusLine(int y, bool *validp)
+{
+	*validp = false;
+	CheckLineHashes();
+	if (!D_lhash || y < 0 || y >= D_height)
+		return NULL;
+	if (D_slineslen != D_height || D_slineswidth != D_width) {
+		FreeStatusLines();
+		D_slines = calloc(D_height, sizeof(struct mline));
+		D_slinestamp = calloc(D_height, sizeof(uint32_t));
+		if (!D_slines || !D_slinestamp) {
+			FreeStatusLines();
+			return NULL;
+		}
+		D_slineslen = D_height;
+		D_slineswidth = D_width;
+	}
+	if (!D_slines[y].image && !AllocSline(D_slines + y, D_width + 1))
+		return NULL;
+	if (sline_newlen < D_width + 1) {
+		FreeSline(&sline_new);
+		sline_newlen = AllocSline(&sline_new, D_width + 1) ? D_width + 1 : 0;
+		if (!sline_newlen)
+			return NULL;
+	}
+	sline_new.image[D_width] = ' ';	/* never wraps */
+	D_slines[y].image[D_width] = ' ';
+	*validp = D_slinestamp[y] && D_lhash[y] == D_slinestamp[y];
+	return D_slines + y;
+}
+
+/* send the changed cells from..to of status line y and remember them */
+static void UpdateStatusLine(struct mline *sl, bool valid, int y, int from, int to)
+{
+	size_t n = (to - from + 1) * sizeof(uint32_t);
+
+	DisplayLine(valid ? sl : &mline_null, &sline_new, y, from, to);
+	memmove(sl->image + from, sline_new.image + from, n);
+	memmove(sl->attr + from, sline_new.attr + from, n);
+	memmove(sl->font + from, sline_new.font + from, n);
+	memmove(sl->fontx + from, sline_new.fontx + from, n);
+	memmove(sl->colorbg + from, sline_new.colorbg + from, n);
+	memmove(sl->colorfg + from, sline_new.colorfg + from, n);
+}
+
+static void StampStatusLine(int y)
+{
+	static uint32_t stamp;
+
+	stamp = (stamp + 2) | 1;
+	D_slinestamp[y] = D_lhash[y] = stamp;
+}
+
+static void SlinePut(struct mline *ml, int x, int c, struct mchar *r)
+{
+	ml->image[x] = (unsigned char)c;
+	ml->attr[x] = r->attr;
+	ml->font[x] = r->font;
+	ml->fontx[x] = r->fontx;
+	ml->colorbg[x] = r->colorbg;
+	ml->colorfg[x] = r->colorfg;
+}
+
+/* true if every char of s takes exactly one cell */
+static bool IsPlainStr(const char *s)
+{
+	for (; *s; s++)
+		if ((unsigned char)*s < ' ' || (unsigned char)*s >= 0x7f)
+			return false;
+	return true;
+}
+
+/*
+ * Like PutWinMsg(), but store the cells in ml from column x on.
+ * Returns the rendition in effect after the message.
+ */
+static struct mchar WinMsgCells(char *s, int start, int max, struct mchar rend, struct mline *ml, int x)
+{
+	int i, p, l, n;
+	uint64_t r;
+	struct mchar rendstack[MAX_WINMSG_REND];
+	int rendstackn = 0;
+
+	if (s != g_winmsg->buf) {
+		l = strlen(s);
+		if (l > max)
+			l = max;
+		l -= start;
+		s += start;
+		while (l-- > 0)
+			SlinePut(ml, x++, *s++, &rend);
+		return rend;
+	}
+	p = 0;
+	l = strlen(s);
+	for (i = 0; i < g_winmsg->numrend && max > 0; i++) {
+		if (p > g_winmsg->rendpos[i] || g_winmsg->rendpos[i] > l)
+			break;
+		if (p < g_winmsg->rendpos[i]) {
+			n = g_winmsg->rendpos[i] - p;
+			if (n > max)
+				n = max;
+			max -= n;
+			p += n;
+			while (n-- > 0) {
+				if (start-- > 0)
+					s++;
+				else
+					SlinePut(ml, x++, *s++, &rend);
+			}
+		}
+		r = g_winmsg->rend[i];
+		if (r == 0) {
+			if (rendstackn > 0)
+				rend = rendstack[--rendstackn];
+		} else {
+			rendstack[rendstackn++] = rend;
+			ApplyAttrColor(r, &rend);
+		}
+	}
+	if (p < l) {
+		n = l - p;
+		if (n > max)
+			n = max;
+		while (n-- > 0) {
+			if (start-- > 0)
+				s++;
+			else
+				SlinePut(ml, x++, *s++, &rend);
+		}
+	}
+	return rend;
+}
+
+/*
+ * Draw hardstatus str on line y, padded with its last rendition if pad
+ * is set. Returns false if it has to be drawn the plain way.
+ */
+static bool PutStatusLine(char *str, int y, bool pad)
+{
+	struct mline *sl;
+	struct mchar rend;
+	bool valid;
+	int x, l;
+
+	if (!IsPlainStr(str) || !(sl = StatusLine(y, &valid)))
+		return false;
+	l = strlen(str);
+	if (l > D_width)
+		l = D_width;
+	rend = WinMsgCells(str, 0, l, mchar_null, &sline_new, 0);
+	for (x = l; x < D_width; x++)
+		SlinePut(&sline_new, x, ' ', pad ? &rend : &mchar_blank);
+	UpdateStatusLine(sl, valid, y, 0, D_width - 1);
+	StampStatusLine(y);
+	return true;
+}
+
+/*
+ * Refresh from..to of line y if it holds nothing but captions and the
+ * separators between them. Returns false if it holds anything else.
+ */
+static bool RefreshCaptionLine(int y, int from, int to)
+{
+	struct mline *sl;
+	struct mchar rend;
+	Canvas *cv;
+	Window *p;
+	char *buf;
+	bool valid, keep;
+	int x, xx, l, extrabytes;
+
+	if ((y == D_height - 1 && D_has_hstatus == HSTATUS_LASTLINE) || (y == 0 && D_has_hstatus == HSTATUS_FIRSTLINE))
+		return false;
+	for (x = from; x <= to;) {
+		for (cv = D_cvlist; cv; cv = cv->c_next) {
+			if (y == (captiontop ? cv->c_ys - 1 : cv->c_ye + 1) && x >= cv->c_xs && x <= cv->c_xe) {
+				x = cv->c_xe + 1;
+				break;
+			}
+			if (x == cv->c_xe + 1 && (y >= cv->c_ys - captiontop) && (y <= cv->c_ye + !captiontop)) {
+				x++;
+				break;
+			}
+		}
+		if (!cv)
+			return false;
+	}
+	if (!(sl = StatusLine(y, &valid)))
+		return false;
+	/* the shadow is only whole if it was or all of it gets drawn now */
+	keep = valid || (from == 0 && to == D_width - 1);
+
+	while (from <= to) {
+		for (cv = D_cvlist; cv; cv = cv->c_next) {
+			if (y == (captiontop ? cv->c_ys - 1 : cv->c_ye + 1) && from >= cv->c_xs && from <= cv->c_xe) {
+#ifdef UTF8
+				extrabytes = strlen(captionstring) - strlen_onscreen(captionstring, NULL);
+#else
+				extrabytes = 0;
+#endif
+				p = Layer2Window(cv->c_layer);
+				buf =
+				    MakeWinMsgEv(NULL, captionstring, p, '%',
+						 cv->c_xe - cv->c_xs + (cv->c_xe + 1 < D_width
+									|| D_CLP) + extrabytes, &cv->c_captev, 0);
+				if (cv->c_captev.timeout.tv_sec)
+					evenq(&cv->c_captev);
+				xx = to > cv->c_xe ? cv->c_xe : to;
+				l = strlen(buf);
+				if (l > xx - cv->c_xs + 1)
+					l = xx - cv->c_xs + 1;
+				if (extrabytes || !IsPlainStr(buf)) {
+					/* multibyte or control chars, draw it the plain way */
+					GotoPos(from, y);
+					SetRendition(&mchar_so);
+					l = PrePutWinMsg(buf, from - cv->c_xs, l + extrabytes);
+					from = cv->c_xs + l;
+					for (; from <= xx; from++)
+						PUTCHARLP(' ');
+					keep = false;
+					break;
+				}
+				rend = WinMsgCells(buf, from - cv->c_xs, l, mchar_so, &sline_new, from);
+				for (x = cv->c_xs + l > from ? cv->c_xs + l : from; x <= xx; x++)
+					SlinePut(&sline_new, x, ' ', &rend);
+				UpdateStatusLine(sl, valid, y, from, xx);
+				from = xx + 1;
+				break;
+			}
+			if (from == cv->c_xe + 1 && (y >= cv->c_ys - captiontop) && (y <= cv->c_ye + !captiontop)) {
+				SlinePut(&sline_new, from, ' ', &mchar_so);
+				UpdateStatusLine(sl, valid, y, from, from);
+				from++;
+				break;
+			}
+		}
+	}
+	if (keep)
+		StampStatusLine(y);
+	return true;
+}
+
 /* refresh the display's hstatus line */
 void ShowHStatus(char *str)
 {
@@ -1633,14 +2272,16 @@ void ShowHStatus(char *str)
 		l = strlen(str);
 		if (l > D_width)
 			l = D_width;
-		GotoPos(0, D_height - 1);
-		SetRendition(&mchar_null);
-		l = PrePutWinMsg(str, 0, l);
-		if (!captionalways && D_cvlist && !D_cvlist->c_next)
-			while (l++ < D_width)
-				PUTCHARLP(' ');
-		if (l < D_width)
-			ClearArea(l, D_height - 1, l, D_width - 1, D_width - 1, D_height - 1, 0, 0);
+		if (!PutStatusLine(str, D_height - 1, !captionalways && D_cvlist && !D_cvlist->c_next)) {
+			GotoPos(0, D_height - 1);
+			SetRendition(&mchar_null);
+			l = PrePutWinMsg(str, 0, l);
+			if (!captionalways && D_cvlist && !D_cvlist->c_next)
+				while (l++ < D_width)
+					PUTCHARLP(' ');
+			if (l < D_width)
+				ClearArea(l, D_height - 1, l, D_width - 1, D_width - 1, D_height - 1, 0, 0);
+		}
 		if (ox != -1 && oy != -1)
 			GotoPos(ox, oy);
 		D_hstatus = (str != NULL);
@@ -1652,14 +2293,16 @@ void ShowHStatus(char *str)
 		l = strlen(str);
 		if (l > D_width)
 			l = D_width;
-		GotoPos(0, 0);
-		SetRendition(&mchar_null);
-		l = PrePutWinMsg(str, 0, l);
-		if (!captionalways || (D_cvlist && !D_cvlist->c_next))
-			while (l++ < D_width)
-				PUTCHARLP(' ');
-		if (l < D_width)
-			ClearArea(l, 0, l, D_width - 1, D_width - 1, 0, 0, 0);
+		if (!PutStatusLine(str, 0, !captionalways || (D_cvlist && !D_cvlist->c_next))) {
+			GotoPos(0, 0);
+			SetRendition(&mchar_null);
+			l = PrePutWinMsg(str, 0, l);
+			if (!captionalways || (D_cvlist && !D_cvlist->c_next))
+				while (l++ < D_width)
+					PUTCHARLP(' ');
+			if (l < D_width)
+				ClearArea(l, 0, l, D_width - 1, D_width - 1, 0, 0, 0);
+		}
 		if (ox != -1 && oy != -1)
 			GotoPos(ox, oy);
 		D_hstatus = (str != NULL);
@@ -1735,6 +2378,9 @@ void RefreshLine(int y, int from, int to, int isblank)
 			D_status_len = to + 1;
 		return;		/* can't refresh status */
 	}
+	if (RefreshCaptionLine(y, from, to))
+		return;
+	INVAL_LHASH(y);
 
 	if (isblank == 0 && D_CE && to == D_width - 1 && from < to && D_status != STATUS_ON_HS) {
 		GotoPos(from, y);
@@ -1883,6 +2529,7 @@ void ClearLine(struct mline *oml, int y, int from, int to, int bce)
 	int x;
 	struct mchar bcechar;
 
+	INVAL_LHASH(y);
 	if (D_UT)		/* Safe to erase ? */
 		SetRendition(&mchar_null);
 	if (D_BE)
@@ -1915,6 +2562,11 @@ void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 	int x;
 	int last2flag = 0, delete_lp = 0;
 
+	/* the line over itself: nothing would be drawn */
+	if (ml && ml == oml && !D_mbcs &&
+	    !(D_lp_missing && y == D_bot) && (to < D_width - 1 || ml->image[to + 1]))
+		return;
+	INVAL_LHASH(y);
 	if (!D_CLP && y == D_bot && to == D_width - 1) {
 		if (D_lp_missing || !cmp_mline(oml, ml, to)) {
 			if ((D_IC || D_IM) && from < to && !dw_left(ml, to, D_encoding)) {
@@ -1937,9 +2589,12 @@ void DisplayLine(struct mline *oml, struct mline *ml, int y, int from, int to)
 	}
 	for (x = from; x <= to; x++) {
 		if (ml != NULL) {
-			if ((x < to || x != D_width - 1 || ml->image[x + 1]))
-				if (cmp_mline(oml, ml, x))
-					continue;
+			/* skip to the next changed cell, the wrap column is always drawn */
+			if ((x = MlineDiff(oml, ml, x, to)) > to) {
+				if (to != D_width - 1 || ml->image[to + 1])
+					break;
+				x = to;
+			}
 			GotoPos(x, y);
 			if (dw_right(ml, x, D_encoding)) {
 				if (x > 0) {
@@ -1991,6 +2646,7 @@ void PutChar(struct mchar *c, int x, int y)
 void InsChar(struct mchar *c, int x, int xe, int y, struct mline *oml)
 {
 	(void)oml; /* unused */
+	INVAL_LHASH(y);
 	GotoPos(x, y);
 	if (y == D_bot && !D_CLP) {
 		if (x == D_width - 1) {
@@ -2208,6 +2864,7 @@ void Flush(int progress)
 	if (D_userfd < 0) {
 		D_obuffree += l;
 		D_obufp = D_obuf;
+		InvalidateLineHashes();
 		return;
 	}
 	p = D_obuf;
@@ -2243,6 +2900,8 @@ void Flush(int progress)
 		p += wr;
 		l -= wr;
 	}
+	if (l)
+		InvalidateLineHashes();	/* output was thrown away */
 	D_obuffree += l;
 	D_obufp = D_obuf;
 	if (!progress) {
@@ -2264,6 +2923,7 @@ void freetty()
 		free(D_obuf);
 	D_obuf = 0;
 	D_obuflen = 0;
+	InvalidateLineHashes();
 	D_obuflenmax = -D_obufmax;
 	D_blocked = 0;
 	D_blocked_fuzz = 0;
@@ -2338,6 +2998,7 @@ void NukePending()
 
 	/* Throw away any output that we can... */
 	tcflush(D_userfd, TCOFLUSH);
+	InvalidateLineHashes();
 
 	D_obufp = D_obuf;
 	D_obuffree += len;
@@ -2493,7 +3154,7 @@ static void disp_readev_fn(Event *event, void *data)
 		size = IOSIZE;
 	else {
 		if (W_UWP(D_fore))
-			size = sizeof(D_fore->w_pwin->p_inbuf) - D_fore->w_pwin->p_inlen;
+			size = D_fore->w_pwin->p_insize - D_fore->w_pwin->p_inlen;
 		else
 			size = sizeof(D_fore->w_inbuf) - D_fore->w_inlen;
 	}
@@ -2647,6 +3308,7 @@ static void disp_blocked_fn(Event *event, void *data)
 	display = (Display *)data;
 	if (D_obufp - D_obuf > D_obufmax + D_blocked_fuzz) {
 		D_blocked = 1;
+		InvalidateLineHashes();	/* output will be skipped */
 		/* re-enable all windows */
 		for (p = windows; p; p = p->w_next)
 			if (p->w_readev.condneg == &D_obuflenmax) {
@@ -2837,6 +3499,7 @@ void RunBlanker(char **cmdv)
 	D_blankerpid = pid;
 	evenq(&D_blankerev);
 	D_blocked = 4;
+	InvalidateLineHashes();
 	ClearAll();
 	if (slave != -1)
 		close(slave);
@@ -2847,3 +3510,144 @@ void ClearScrollbackBuffer()
 	if (D_CE3)
 		AddCStr(D_CE3);
 }
+
+static void GetDispState(struct dispstate *st)
+{
+	st->top = D_top;
+	st->bot = D_bot;
+	st->x = D_x;
+	st->y = D_y;
+	st->rend = D_rend;
+	st->atyp = D_atyp;
+	st->mbcs = D_mbcs;
+	st->realfont = D_realfont;
+	st->insert = D_insert;
+	st->lp_missing = D_lp_missing;
+	st->lpchar = D_lpchar;
+}
+
+static void SetDispState(struct dispstate *st)
+{
+	D_top = st->top;
+	D_bot = st->bot;
+	D_x = st->x;
+	D_y = st->y;
+	D_rend = st->rend;
+	D_atyp = st->atyp;
+	D_mbcs = st->mbcs;
+	D_realfont = st->realfont;
+	D_insert = st->insert;
+	D_lp_missing = st->lp_missing;
+	D_lpchar = st->lpchar;
+}
+
+static bool SameDispState(struct dispstate *st1, struct dispstate *st2)
+{
+	return st1->top == st2->top && st1->bot == st2->bot
+	    && st1->x == st2->x && st1->y == st2->y
+	    && cmp_mchar(&st1->rend, &st2->rend) && st1->rend.mbcs == st2->rend.mbcs
+	    && st1->atyp == st2->atyp && st1->mbcs == st2->mbcs
+	    && st1->realfont == st2->realfont && st1->insert == st2->insert
+	    && st1->lp_missing == st2->lp_missing
+	    && (!st1->lp_missing || (cmp_mchar(&st1->lpchar, &st2->lpchar)
+				     && st1->lpchar.mbcs == st2->lpchar.mbcs));
+}
+
+/* Is the current display able to share output at all? */
+static bool CanShareOutput(void)
+{
+	return D_tcinited && D_status == STATUS_OFF && D_status_obuffree < 0;
+}
+
+static bool SameCanvasGeometry(Canvas *cv1, Canvas *cv2)
+{
+	Viewport *vp1, *vp2;
+
+	if (cv1->c_xoff != cv2->c_xoff || cv1->c_yoff != cv2->c_yoff
+	    || cv1->c_xs != cv2->c_xs || cv1->c_xe != cv2->c_xe
+	    || cv1->c_ys != cv2->c_ys || cv1->c_ye != cv2->c_ye)
+		return false;
+	for (vp1 = cv1->c_vplist, vp2 = cv2->c_vplist; vp1 && vp2; vp1 = vp1->v_next, vp2 = vp2->v_next)
+		if (vp1->v_xoff != vp2->v_xoff || vp1->v_yoff != vp2->v_yoff
+		    || vp1->v_xs != vp2->v_xs || vp1->v_xe != vp2->v_xe
+		    || vp1->v_ys != vp2->v_ys || vp1->v_ye != vp2->v_ye)
+			return false;
+	return vp1 == vp2;
+}
+
+static bool SameOutputClass(Display *d1, Display *d2)
+{
+	return d1->d_tcsig == d2->d_tcsig && d1->d_encoding == d2->d_encoding
+	    && d1->d_width == d2->d_width && d1->d_height == d2->d_height
+	    && d1->d_vpxmin == d2->d_vpxmin && d1->d_vpxmax == d2->d_vpxmax
+	    && d1->d_has_hstatus == d2->d_has_hstatus && d1->d_hstatus == d2->d_hstatus
+	    && !strcmp(d1->d_termname, d2->d_termname);
+}
+
+void DisplayShareInit(DisplayShare *ds)
+{
+	ds->ds_n = 0;
+	ds->ds_cur = -1;
+}
+
+/*
+ * Try to satisfy the current display's part of a layer update by
+ * copying the output already generated for an identical display.
+ * Returns true if the output was copied.
+ */
+bool DisplayShareCopy(DisplayShare *ds, Canvas *cv)
+{
+	struct dispstate st;
+	Display *d;
+	int len;
+
+	if (!ds->ds_n || !CanShareOutput())
+		return false;
+	GetDispState(&st);
+	for (int i = 0; i < ds->ds_n; i++) {
+		d = ds->ds_lead[i].d;
+		if (d == display || !SameOutputClass(d, display))
+			continue;
+		if (!SameCanvasGeometry(ds->ds_lead[i].cv, cv) || !SameDispState(&ds->ds_lead[i].pre, &st))
+			continue;
+		len = ds->ds_lead[i].len;
+		while (D_obuffree - len <= 0)
+			Resize_obuf();
+		memmove(D_obufp, d->d_obuf + ds->ds_lead[i].start, len);
+		D_obufp += len;
+		D_obuffree -= len;
+		SetDispState(&ds->ds_lead[i].post);
+		/* the copied output changed the canvas behind our line hashes */
+		InvalLineHash(cv->c_ys, cv->c_ye);
+		return true;
+	}
+	return false;
+}
+
+/* Start recording the current display's output as a possible leader */
+void DisplayShareBegin(DisplayShare *ds, Canvas *cv)
+{
+	ds->ds_cur = -1;
+	if (ds->ds_n >= DISPSHARE_MAX || !CanShareOutput())
+		return;
+	ds->ds_cur = ds->ds_n;
+	ds->ds_lead[ds->ds_cur].d = display;
+	ds->ds_lead[ds->ds_cur].cv = cv;
+	ds->ds_lead[ds->ds_cur].start = D_obufp - D_obuf;
+	GetDispState(&ds->ds_lead[ds->ds_cur].pre);
+}
+
+void DisplayShareEnd(DisplayShare *ds)
+{
+	int cur = ds->ds_cur;
+
+	if (cur < 0)
+		return;
+	ds->ds_cur = -1;
+	/* status messages may have taken over the buffer in the meantime */
+	if (display != ds->ds_lead[cur].d || !CanShareOutput() || D_obufp - D_obuf < ds->ds_lead[cur].start)
+		return;
+	ds->ds_lead[cur].len = D_obufp - D_obuf - ds->ds_lead[cur].start;
+	GetDispState(&ds->ds_lead[cur].post);
+	ds->ds_n++;
+}
@@ -93,6 +93,7 @@ struct Display {
 	char  d_termname[MAXTERMLEN + 1]; /* $TERM */
 	char	*d_tentry;		/* buffer for tgetstr */
 	char	d_tcinited;		/* termcap inited flag */
+	uint32_t d_tcsig;		/* hash of the terminal capabilities */
 	int	d_width, d_height;	/* width/height of the screen */
 	int	d_defwidth, d_defheight;	/* default width/height of windows */
 	int	d_top, d_bot;		/* scrollregion start/end */
@@ -111,6 +112,14 @@ struct Display {
 	HardStatus	d_has_hstatus;		/* display has hardstatus line */
 	bool d_hstatus;		/* hardstatus used */
 	int	d_lp_missing;		/* last character on bot line missing */
+	uint32_t *d_lhash;		/* hash of each line as last drawn, 0 if unknown */
+	int	d_lhashlen;		/* number of lines in d_lhash */
+	int	d_lhashwidth;		/* display width d_lhash was made for */
+	struct mline *d_slines;		/* status lines as last drawn */
+	uint32_t *d_slinestamp;		/* d_lhash value while d_slines is shown */
+	int	d_slineslen;		/* number of lines in d_slines */
+	int	d_slineswidth;		/* display width d_slines was made for */
+	int	d_msgdirty;		/* hardstatus redraw pending */
 	int   d_mouse;			/* mouse mode */
 	int	d_mousetrack;		/* set when user wants to use mouse even when the window
 					   does not */
@@ -200,6 +209,7 @@ struct Display {
 #define D_termname	DISPLAY(d_termname)
 #define D_tentry	DISPLAY(d_tentry)
 #define D_tcinited	DISPLAY(d_tcinited)
+#define D_tcsig		DISPLAY(d_tcsig)
 #define D_width		DISPLAY(d_width)
 #define D_height	DISPLAY(d_height)
 #define D_defwidth	DISPLAY(d_defwidth)
@@ -222,6 +232,14 @@ struct Display {
 #define D_has_hstatus	DISPLAY(d_has_hstatus)
 #define D_hstatus	DISPLAY(d_hstatus)
 #define D_lp_missing	DISPLAY(d_lp_missing)
+#define D_lhash		DISPLAY(d_lhash)
+#define D_lhashlen	DISPLAY(d_lhashlen)
+#define D_lhashwidth	DISPLAY(d_lhashwidth)
+#define D_slines	DISPLAY(d_slines)
+#define D_slinestamp	DISPLAY(d_slinestamp)
+#define D_slineslen	DISPLAY(d_slineslen)
+#define D_slineswidth	DISPLAY(d_slineswidth)
+#define D_msgdirty	DISPLAY(d_msgdirty)
 #define D_mouse		DISPLAY(d_mouse)
 #define D_mousetrack	DISPLAY(d_mousetrack)
 #define D_xtermosc	DISPLAY(d_xtermosc)
@@ -298,6 +316,38 @@ struct Display {
 
 #define OUTPUT_BLOCK_SIZE 256  /* Block size of output to tty */
 
+/*
+ * Output sharing: displays of the same terminal type that are in the
+ * same output state generate identical bytes for a layer update, so
+ * the bytes generated for the first one (the leader) are copied to the
+ * others. See LPutChar() and friends in layer.c.
+ */
+#define DISPSHARE_MAX 8
+
+struct dispstate {
+	int	top, bot;
+	int	x, y;
+	struct mchar rend;
+	char	atyp;
+	int	mbcs;
+	int	realfont;
+	bool	insert;
+	int	lp_missing;
+	struct mchar lpchar;
+};
+
+typedef struct DisplayShare DisplayShare;
+struct DisplayShare {
+	int	ds_n;			/* number of recorded leaders */
+	int	ds_cur;			/* leader being recorded, -1 if none */
+	struct {
+		Display *d;
+		Canvas *cv;
+		int	start, len;	/* generated bytes in leader's obuf */
+		struct dispstate pre, post;
+	} ds_lead[DISPSHARE_MAX];
+};
+
 #define AddChar(c)		\
 do				\
   {				\
@@ -364,6 +414,12 @@ void  ResetIdle (void);
 void  KillBlanker (void);
 void  DisplaySleep1000 (int, int);
 void  ClearScrollbackBuffer (void);
+void  InvalidateLineHashes (void);
+uint32_t HashMline (struct mline *, int);
+void  DisplayShareInit (DisplayShare *);
+bool  DisplayShareCopy (DisplayShare *, Canvas *);
+void  DisplayShareBegin (DisplayShare *, Canvas *);
+void  DisplayShareEnd (DisplayShare *);
 
 /* global variables */
 
@@ -707,6 +707,7 @@ void WinSwitchEncoding(Window *p, int encoding)
 		ml = j < p->w_height ? &p->w_mlines[j] : &p->w_hlines[j - p->w_height];
 		if (ml->font == null && ml->fontx == 0 && encodings[p->w_encoding].deffont == 0)
 			continue;
+		touch_mline(ml);
 		for (i = 0; i < p->w_width; i++) {
 			c = ml->image[i] | (ml->font[i] << 8);
 			if (p->w_encoding == UTF8)
@@ -919,6 +920,136 @@ int utf8_iscomb(int c)
 	return bisearch(c, combining, sizeof(combining) / sizeof(struct interval) - 1);
 }
 
+/*
+ * Unicode simple case folding, generated from the "C" and "S" lines of
+ * CaseFolding.txt (Unicode 14.0) with runs of the same delta merged.
+ * Entries with alt set only fold every other character, starting at first.
+ */
+int utf8_casefold(int c)
+{
+	static const struct {
+		int first, last, delta, alt;
+	} folds[] = {
+		{0x00B5, 0x00B5, 775, 0}, {0x00C0, 0x00D6, 32, 0},
+		{0x00D8, 0x00DE, 32, 0}, {0x0100, 0x012E, 1, 1},
+		{0x0132, 0x0136, 1, 1}, {0x0139, 0x0147, 1, 1},
+		{0x014A, 0x0176, 1, 1}, {0x0178, 0x0178, -121, 0},
+		{0x0179, 0x017D, 1, 1}, {0x017F, 0x017F, -268, 0},
+		{0x0181, 0x0181, 210, 0}, {0x0182, 0x0184, 1, 1},
+		{0x0186, 0x0186, 206, 0}, {0x0187, 0x0187, 1, 0},
+		{0x0189, 0x018A, 205, 0}, {0x018B, 0x018B, 1, 0},
+		{0x018E, 0x018E, 79, 0}, {0x018F, 0x018F, 202, 0},
+		{0x0190, 0x0190, 203, 0}, {0x0191, 0x0191, 1, 0},
+		{0x0193, 0x0193, 205, 0}, {0x0194, 0x0194, 207, 0},
+		{0x0196, 0x0196, 211, 0}, {0x0197, 0x0197, 209, 0},
+		{0x0198, 0x0198, 1, 0}, {0x019C, 0x019C, 211, 0},
+		{0x019D, 0x019D, 213, 0}, {0x019F, 0x019F, 214, 0},
+		{0x01A0, 0x01A4, 1, 1}, {0x01A6, 0x01A6, 218, 0},
+		{0x01A7, 0x01A7, 1, 0}, {0x01A9, 0x01A9, 218, 0},
+		{0x01AC, 0x01AC, 1, 0}, {0x01AE, 0x01AE, 218, 0},
+		{0x01AF, 0x01AF, 1, 0}, {0x01B1, 0x01B2, 217, 0},
+		{0x01B3, 0x01B5, 1, 1}, {0x01B7, 0x01B7, 219, 0},
+		{0x01B8, 0x01B8, 1, 0}, {0x01BC, 0x01BC, 1, 0},
+		{0x01C4, 0x01C4, 2, 0}, {0x01C5, 0x01C5, 1, 0},
+		{0x01C7, 0x01C7, 2, 0}, {0x01C8, 0x01C8, 1, 0},
+		{0x01CA, 0x01CA, 2, 0}, {0x01CB, 0x01DB, 1, 1},
+		{0x01DE, 0x01EE, 1, 1}, {0x01F1, 0x01F1, 2, 0},
+		{0x01F2, 0x01F4, 1, 1}, {0x01F6, 0x01F6, -97, 0},
+		{0x01F7, 0x01F7, -56, 0}, {0x01F8, 0x021E, 1, 1},
+		{0x0220, 0x0220, -130, 0}, {0x0222, 0x0232, 1, 1},
+		{0x023A, 0x023A, 10795, 0}, {0x023B, 0x023B, 1, 0},
+		{0x023D, 0x023D, -163, 0}, {0x023E, 0x023E, 10792, 0},
+		{0x0241, 0x0241, 1, 0}, {0x0243, 0x0243, -195, 0},
+		{0x0244, 0x0244, 69, 0}, {0x0245, 0x0245, 71, 0},
+		{0x0246, 0x024E, 1, 1}, {0x0345, 0x0345, 116, 0},
+		{0x0370, 0x0372, 1, 1}, {0x0376, 0x0376, 1, 0},
+		{0x037F, 0x037F, 116, 0}, {0x0386, 0x0386, 38, 0},
+		{0x0388, 0x038A, 37, 0}, {0x038C, 0x038C, 64, 0},
+		{0x038E, 0x038F, 63, 0}, {0x0391, 0x03A1, 32, 0},
+		{0x03A3, 0x03AB, 32, 0}, {0x03C2, 0x03C2, 1, 0},
+		{0x03CF, 0x03CF, 8, 0}, {0x03D0, 0x03D0, -30, 0},
+		{0x03D1, 0x03D1, -25, 0}, {0x03D5, 0x03D5, -15, 0},
+		{0x03D6, 0x03D6, -22, 0}, {0x03D8, 0x03EE, 1, 1},
+		{0x03F0, 0x03F0, -54, 0}, {0x03F1, 0x03F1, -48, 0},
+		{0x03F4, 0x03F4, -60, 0}, {0x03F5, 0x03F5, -64, 0},
+		{0x03F7, 0x03F7, 1, 0}, {0x03F9, 0x03F9, -7, 0},
+		{0x03FA, 0x03FA, 1, 0}, {0x03FD, 0x03FF, -130, 0},
+		{0x0400, 0x040F, 80, 0}, {0x0410, 0x042F, 32, 0},
+		{0x0460, 0x0480, 1, 1}, {0x048A, 0x04BE, 1, 1},
+		{0x04C0, 0x04C0, 15, 0}, {0x04C1, 0x04CD, 1, 1},
+		{0x04D0, 0x052E, 1, 1}, {0x0531, 0x0556, 48, 0},
+		{0x10A0, 0x10C5, 7264, 0}, {0x10C7, 0x10C7, 7264, 0},
+		{0x10CD, 0x10CD, 7264, 0}, {0x13F8, 0x13FD, -8, 0},
+		{0x1C80, 0x1C80, -6222, 0}, {0x1C81, 0x1C81, -6221, 0},
+		{0x1C82, 0x1C82, -6212, 0}, {0x1C83, 0x1C84, -6210, 0},
+		{0x1C85, 0x1C85, -6211, 0}, {0x1C86, 0x1C86, -6204, 0},
+		{0x1C87, 0x1C87, -6180, 0}, {0x1C88, 0x1C88, 35267, 0},
+		{0x1C90, 0x1CBA, -3008, 0}, {0x1CBD, 0x1CBF, -3008, 0},
+		{0x1E00, 0x1E94, 1, 1}, {0x1E9B, 0x1E9B, -58, 0},
+		{0x1E9E, 0x1E9E, -7615, 0}, {0x1EA0, 0x1EFE, 1, 1},
+		{0x1F08, 0x1F0F, -8, 0}, {0x1F18, 0x1F1D, -8, 0},
+		{0x1F28, 0x1F2F, -8, 0}, {0x1F38, 0x1F3F, -8, 0},
+		{0x1F48, 0x1F4D, -8, 0}, {0x1F59, 0x1F5F, -8, 1},
+		{0x1F68, 0x1F6F, -8, 0}, {0x1F88, 0x1F8F, -8, 0},
+		{0x1F98, 0x1F9F, -8, 0}, {0x1FA8, 0x1FAF, -8, 0},
+		{0x1FB8, 0x1FB9, -8, 0}, {0x1FBA, 0x1FBB, -74, 0},
+		{0x1FBC, 0x1FBC, -9, 0}, {0x1FBE, 0x1FBE, -7173, 0},
+		{0x1FC8, 0x1FCB, -86, 0}, {0x1FCC, 0x1FCC, -9, 0},
+		{0x1FD8, 0x1FD9, -8, 0}, {0x1FDA, 0x1FDB, -100, 0},
+		{0x1FE8, 0x1FE9, -8, 0}, {0x1FEA, 0x1FEB, -112, 0},
+		{0x1FEC, 0x1FEC, -7, 0}, {0x1FF8, 0x1FF9, -128, 0},
+		{0x1FFA, 0x1FFB, -126, 0}, {0x1FFC, 0x1FFC, -9, 0},
+		{0x2126, 0x2126, -7517, 0}, {0x212A, 0x212A, -8383, 0},
+		{0x212B, 0x212B, -8262, 0}, {0x2132, 0x2132, 28, 0},
+		{0x2160, 0x216F, 16, 0}, {0x2183, 0x2183, 1, 0},
+		{0x24B6, 0x24CF, 26, 0}, {0x2C00, 0x2C2F, 48, 0},
+		{0x2C60, 0x2C60, 1, 0}, {0x2C62, 0x2C62, -10743, 0},
+		{0x2C63, 0x2C63, -3814, 0}, {0x2C64, 0x2C64, -10727, 0},
+		{0x2C67, 0x2C6B, 1, 1}, {0x2C6D, 0x2C6D, -10780, 0},
+		{0x2C6E, 0x2C6E, -10749, 0}, {0x2C6F, 0x2C6F, -10783, 0},
+		{0x2C70, 0x2C70, -10782, 0}, {0x2C72, 0x2C72, 1, 0},
+		{0x2C75, 0x2C75, 1, 0}, {0x2C7E, 0x2C7F, -10815, 0},
+		{0x2C80, 0x2CE2, 1, 1}, {0x2CEB, 0x2CED, 1, 1},
+		{0x2CF2, 0x2CF2, 1, 0}, {0xA640, 0xA66C, 1, 1},
+		{0xA680, 0xA69A, 1, 1}, {0xA722, 0xA72E, 1, 1},
+		{0xA732, 0xA76E, 1, 1}, {0xA779, 0xA77B, 1, 1},
+		{0xA77D, 0xA77D, -35332, 0}, {0xA77E, 0xA786, 1, 1},
+		{0xA78B, 0xA78B, 1, 0}, {0xA78D, 0xA78D, -42280, 0},
+		{0xA790, 0xA792, 1, 1}, {0xA796, 0xA7A8, 1, 1},
+		{0xA7AA, 0xA7AA, -42308, 0}, {0xA7AB, 0xA7AB, -42319, 0},
+		{0xA7AC, 0xA7AC, -42315, 0}, {0xA7AD, 0xA7AD, -42305, 0},
+		{0xA7AE, 0xA7AE, -42308, 0}, {0xA7B0, 0xA7B0, -42258, 0},
+		{0xA7B1, 0xA7B1, -42282, 0}, {0xA7B2, 0xA7B2, -42261, 0},
+		{0xA7B3, 0xA7B3, 928, 0}, {0xA7B4, 0xA7C2, 1, 1},
+		{0xA7C4, 0xA7C4, -48, 0}, {0xA7C5, 0xA7C5, -42307, 0},
+		{0xA7C6, 0xA7C6, -35384, 0}, {0xA7C7, 0xA7C9, 1, 1},
+		{0xA7D0, 0xA7D0, 1, 0}, {0xA7D6, 0xA7D8, 1, 1},
+		{0xA7F5, 0xA7F5, 1, 0}, {0xAB70, 0xABBF, -38864, 0},
+		{0xFF21, 0xFF3A, 32, 0}, {0x10400, 0x10427, 40, 0},
+		{0x104B0, 0x104D3, 40, 0}, {0x10570, 0x1057A, 39, 0},
+		{0x1057C, 0x1058A, 39, 0}, {0x1058C, 0x10592, 39, 0},
+		{0x10594, 0x10595, 39, 0}, {0x10C80, 0x10CB2, 64, 0},
+		{0x118A0, 0x118BF, 32, 0}, {0x16E40, 0x16E5F, 32, 0},
+		{0x1E900, 0x1E921, 34, 0}
+	};
+	int min = 0, max = sizeof(folds) / sizeof(*folds) - 1, mid;
+
+	if (c < 0x80)
+		return c >= 'A' && c <= 'Z' ? c + 32 : c;
+	while (max >= min) {
+		mid = (min + max) / 2;
+		if (c > folds[mid].last)
+			min = mid + 1;
+		else if (c < folds[mid].first)
+			max = mid - 1;
+		else if (folds[mid].alt && (c - folds[mid].first) & 1)
+			return c;
+		else
+			return c + folds[mid].delta;
+	}
+	return c;
+}
+
 static void comb_tofront(int root, int i)
 {
 	for (;;) {
@@ -1000,6 +1131,25 @@ void utf8_handle_comb(unsigned int c, struct mchar *mc)
 	comb_tofront(root, i);
 }
 
+/*
+ * The characters a cell value made by utf8_handle_comb() stands for,
+ * the base character first. Returns their number, at most max.
+ */
+int utf8_combchars(int c, int *cp, int max)
+{
+	int n;
+
+	if (max <= 0)
+		return 0;
+	if (c >= 0xd800 && c < 0xe000 && combchars && combchars[c - 0xd800]) {
+		n = utf8_combchars(combchars[c - 0xd800]->c1, cp, max - 1);
+		cp[n++] = combchars[c - 0xd800]->c2;
+		return n;
+	}
+	*cp = c;
+	return 1;
+}
+
 static int encmatch(char *s1, char *s2)
 {
 	int c1, c2;
@@ -1373,19 +1523,32 @@ int PrepareEncodedChar(int c)
 
 int RecodeBuf(unsigned char *fbuf, int flen, int fenc, int tenc, unsigned char *tbuf)
 {
-	int c, i, j;
 	int decstate = 0, font = 0;
 
+	return RecodeBufPart(fbuf, flen, fenc, tenc, tbuf, &decstate, &font, true);
+}
+
+/*
+ * Recodes a text a piece at a time. The decoder state and the font
+ * carry over from one piece to the next in *decstatep and *fontp, the
+ * font is reset after the last piece.
+ */
+int RecodeBufPart(unsigned char *fbuf, int flen, int fenc, int tenc, unsigned char *tbuf,
+		  int *decstatep, int *fontp, bool last)
+{
+	int c, i, j;
+
 	for (i = j = 0; i < flen; i++) {
 		c = fbuf[i];
-		c = DecodeChar(c, fenc, &decstate);
+		c = DecodeChar(c, fenc, decstatep);
 		if (c == -2)
 			i--;
 		if (c < 0)
 			continue;
-		j += EncodeChar(tbuf ? (char *)tbuf + j : 0, c, tenc, &font);
+		j += EncodeChar(tbuf ? (char *)tbuf + j : 0, c, tenc, fontp);
 	}
-	j += EncodeChar(tbuf ? (char *)tbuf + j : 0, -1, tenc, &font);
+	if (last)
+		j += EncodeChar(tbuf ? (char *)tbuf + j : 0, -1, tenc, fontp);
 	return j;
 }
 
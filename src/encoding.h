@@ -12,7 +12,9 @@ int   ToUtf8 (char *, int);
 int   ToUtf8_comb (char *, int);
 int   utf8_isdouble (int);
 int   utf8_iscomb (int);
+int   utf8_casefold (int);
 void  utf8_handle_comb (unsigned int, struct mchar *);
+int   utf8_combchars (int, int *, int);
 int   ContainsSpecialDeffont (struct mline *, int, int, int);
 int   LoadFontTranslation (int, char *);
 void  LoadFontTranslationsForEncoding (int);
@@ -24,6 +26,7 @@ void  ResetEncoding (Window *);
 int   CanEncodeFont (int, int);
 int   DecodeChar (int, int, int *);
 int   RecodeBuf (unsigned char *, int, int, int, unsigned char *);
+int   RecodeBufPart (unsigned char *, int, int, int, unsigned char *, int *, int *, bool);
 int   PrepareEncodedChar (int);
 int   EncodeChar (char *, int, int, int *);
 
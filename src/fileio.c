@@ -49,6 +49,13 @@
 static char *CatExtra(char *, char *);
 static char *findrcfile(char *);
 
+struct hardcopy;
+static void Hardcopy(char *, int);
+static void HardcopyNext(void);
+static void HardcopyStart(struct hardcopy *);
+static void HardcopyRun(Event *, void *);
+static const char *HardcopyFill(struct hardcopy *);
+
 char *rc_name = "";
 int rc_recursion = 0;
 
@@ -188,6 +195,7 @@ int StartRc(char *rcfilename, int nopanic)
 				continue;
 			}
 			AddStr(args[argc - 1]);
+			InvalidateLineHashes();
 			if (argc != 3) {
 				AddStr("\r\n");
 				Flush(0);
@@ -309,18 +317,291 @@ void RcLine(char *ubuf, int ubufl)
 }
 
 
-static void putc_encoded(FILE *f, uint32_t c, uint32_t font, int encoding) {
-	/* Filler character which is used for double-width characters. */
-	if (c == 0xff && font == 0xff)
+/*
+ * Hardcopies are made and written from the event loop a chunk at a
+ * time, so dumping a large scrollback does not stop the session. They
+ * are written one after the other, in the order they were asked for.
+ * The screen is encoded when the hardcopy is asked for. History lines
+ * do not change, they are found again through w_histcount as new
+ * output pushes them up, and the window hands over the ones that
+ * would drop out of the history before they are written.
+ */
+
+#define HARDCOPY_CHUNK	65536	/* bytes made at a time */
+#define HARDCOPY_CELL	10	/* most bytes a cell encodes to */
+
+struct hardcopy {
+	struct hardcopy *next;
+	Window *win;
+	Display *disp;		/* to tell when it is done, if anyone */
+	char *fn;
+	int fd;
+	bool append;
+	int encoding;
+	uint64_t histcount;	/* w_histcount when it was asked for */
+	int width, histheight;
+	int y;			/* next history line */
+	int hlines;		/* history lines to write */
+	char *tail;		/* the screen */
+	size_t taillen;
+	char *buf;		/* text that is not written yet */
+	size_t off, len, max;
+	const char *err;
+	Event ev;
+};
+
+static struct hardcopy *hardcopies;
+
+/* the text of a line, without trailing blanks, and a newline */
+static size_t HardcopyLine(char *bp, struct mline *ml, int width, int encoding)
+{
+	char *p = bp;
+	int j, k, l;
+
+	for (k = width - 1; k >= 0 && ml->image[k] == ' '; k--) ;
+	for (j = 0; j <= k; j++) {
+		/* filler character which is used for double-width characters */
+		if (ml->image[j] == 0xff && ml->font[j] == 0xff)
+			continue;
+		if ((l = EncodeChar(p, ml->image[j], encoding, NULL)) > 0)
+			p += l;
+	}
+	*p++ = '\n';
+	return p - bp;
+}
+
+/* make room for n more bytes of text */
+static int HardcopyRoom(struct hardcopy *h, size_t n)
+{
+	size_t max = h->max;
+	char *b;
+
+	while (max < h->len + n)
+		max = max ? max * 2 : HARDCOPY_CHUNK + n;
+	if (max == h->max)
+		return 0;
+	if (!(b = realloc(h->buf, max)))
+		return -1;
+	h->buf = b;
+	h->max = max;
+	return 0;
+}
+
+/* a message to the display that asked for the hardcopy, if it is still there */
+static void HardcopyMsg(struct hardcopy *h, int err, const char *fmt, const char *arg)
+{
+	Display *olddisplay = display;
+
+	for (display = displays; display; display = display->d_next)
+		if (display == h->disp)
+			break;
+	if (display)
+		Msg(err, fmt, arg);
+	display = olddisplay;
+}
+
+static void HardcopyFree(struct hardcopy *h)
+{
+	if (h->fd >= 0)
+		close(h->fd);
+	free(h->fn);
+	free(h->tail);
+	free(h->buf);
+	free(h);
+}
+
+/* done with the first hardcopy in line, start the next one */
+static void HardcopyNext(void)
+{
+	struct hardcopy *h = hardcopies;
+
+	hardcopies = h->next;
+	evdeq(&h->ev);
+	h->win->w_hardcopies--;
+	HardcopyFree(h);
+	if (hardcopies)
+		HardcopyStart(hardcopies);
+}
+
+/* open the file of the first hardcopy in line and start writing it */
+static void HardcopyStart(struct hardcopy *h)
+{
+	int sep = h->width + 1;
+
+	h->append = hardcopy_append && !access(h->fn, W_OK);
+	if (UserContext() > 0)
+		UserReturn(open(h->fn, O_WRONLY | O_CREAT | (h->append ? O_APPEND : O_TRUNC), 0666));
+	if ((h->fd = UserStatus()) < 0) {
+		HardcopyMsg(h, 0, "Cannot open \"%s\"", h->fn);
+		HardcopyNext();
+		return;
+	}
+	if (h->append && h->width > 1) {
+		if (HardcopyRoom(h, sep)) {
+			HardcopyMsg(h, 0, "%s", strnomem);
+			HardcopyNext();
+			return;
+		}
+		memmove(h->buf + sep, h->buf, h->len);
+		memset(h->buf, '=', sep);
+		h->buf[0] = '>';
+		h->buf[sep - 2] = '<';
+		h->buf[sep - 1] = '\n';
+		h->len += sep;
+	}
+	/*
+	 * What fits in one chunk is written right away, so that the file is
+	 * complete when the command returns. Only long scrollback dumps are
+	 * left to the event loop.
+	 */
+	if (!HardcopyFill(h) && h->y >= h->hlines) {
+		while (hardcopies == h)
+			HardcopyRun(&h->ev, h);
+		return;
+	}
+	h->ev.type = EV_WRITE;
+	h->ev.fd = h->fd;
+	h->ev.handler = HardcopyRun;
+	h->ev.data = (char *)h;
+	evenq(&h->ev);
+}
+
+/* make the text of the next history lines, then take that of the screen */
+static const char *HardcopyFill(struct hardcopy *h)
+{
+	Window *p = h->win;
+	uint64_t pushed;
+
+	if (h->err)
+		return h->err;
+	if (h->y < h->hlines) {
+		if (p->w_width != h->width || p->w_histheight != h->histheight)
+			return "window size changed";
+		if (HardcopyRoom(h, HARDCOPY_CHUNK + h->width * HARDCOPY_CELL + 1))
+			return strnomem;
+		pushed = p->w_histcount - h->histcount;
+		for (; h->y < h->hlines && h->len < HARDCOPY_CHUNK; h->y++)
+			h->len += HardcopyLine(h->buf + h->len,
+					       &p->w_hlines[(p->w_histidx + h->y - (int)pushed) % p->w_histheight],
+					       h->width, h->encoding);
+	} else if (h->tail && h->len) {
+		/* behind the separator of an appended copy */
+		if (HardcopyRoom(h, h->taillen))
+			return strnomem;
+		memmove(h->buf + h->len, h->tail, h->taillen);
+		h->len += h->taillen;
+		free(h->tail);
+		h->tail = NULL;
+	} else if (h->tail) {
+		free(h->buf);
+		h->buf = h->tail;
+		h->len = h->max = h->taillen;
+		h->tail = NULL;
+	}
+	return NULL;
+}
+
+static void HardcopyRun(Event *ev, void *data)
+{
+	struct hardcopy *h = (struct hardcopy *)data;
+	const char *err;
+	ssize_t n;
+
+	(void)ev; /* unused */
+
+	if (h->off == h->len) {
+		h->off = h->len = 0;
+		if ((err = HardcopyFill(h))) {
+			HardcopyMsg(h, 0, "Hardcopy stopped: %s", err);
+			HardcopyNext();
+			return;
+		}
+		if (h->len == 0) {
+			HardcopyMsg(h, 0, h->append ? "Screen image appended to \"%s\"." :
+				    "Screen image written to \"%s\".", h->fn);
+			HardcopyNext();
+			return;
+		}
+	}
+	if ((n = write(h->fd, h->buf + h->off, h->len - h->off)) < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		HardcopyMsg(h, errno, "%s", h->fn);
+		HardcopyNext();
 		return;
+	}
+	h->off += n;
+}
 
-	char buf[10];
-	int length = EncodeChar(buf, c, encoding, NULL);
-	if (length < 0) {
+/* line up a hardcopy of the window in front, taking its screen */
+static void Hardcopy(char *fn, int dump)
+{
+	struct hardcopy *h, **hp;
+	char *t;
+
+	if (!(h = calloc(1, sizeof(*h))) || !(h->fn = SaveStr(fn))
+	    || !(h->tail = malloc(fore->w_height * (fore->w_width * HARDCOPY_CELL + 1)))) {
+		if (h)
+			free(h->fn);
+		free(h);
+		Msg(0, "%s", strnomem);
 		return;
 	}
-	buf[length] = 0;
-	fputs(buf, f);
+	h->win = fore;
+	h->disp = display && !*rc_name ? display : NULL;
+	h->fd = -1;
+	h->encoding = fore->w_encoding;
+	h->histcount = fore->w_histcount;
+	h->width = fore->w_width;
+	h->histheight = fore->w_histheight;
+	h->hlines = dump == DUMP_SCROLLBACK ? fore->w_histheight : 0;
+	for (int i = 0; i < fore->w_height; i++)
+		h->taillen += HardcopyLine(h->tail + h->taillen, &fore->w_mlines[i], h->width, h->encoding);
+	if ((t = realloc(h->tail, h->taillen)))
+		h->tail = t;
+	fore->w_hardcopies++;
+	for (hp = &hardcopies; *hp; hp = &(*hp)->next)
+		;
+	*hp = h;
+	if (h == hardcopies)
+		HardcopyStart(h);
+}
+
+/* the oldest history line of p drops out, keep it for the hardcopies that still need it */
+void HardcopyKeep(Window *p)
+{
+	struct hardcopy *h;
+	struct mline *ml = &p->w_hlines[p->w_histidx];
+
+	for (h = hardcopies; h; h = h->next) {
+		if (h->win != p || h->err || h->y >= h->hlines || p->w_histcount - h->histcount != (uint64_t)h->y)
+			continue;
+		if (p->w_width != h->width || p->w_histheight != h->histheight)
+			continue;
+		if (HardcopyRoom(h, h->width * HARDCOPY_CELL + 1)) {
+			h->err = strnomem;
+			continue;
+		}
+		h->len += HardcopyLine(h->buf + h->len, ml, h->width, h->encoding);
+		h->y++;
+	}
+}
+
+/* stop the hardcopies of a window that goes away */
+void HardcopyStop(Window *p)
+{
+	struct hardcopy *h, **hp;
+
+	for (hp = &hardcopies; (h = *hp);)
+		if (h->win == p && h != hardcopies) {
+			*hp = h->next;
+			HardcopyFree(h);
+		} else
+			hp = &h->next;
+	if (hardcopies && hardcopies->win == p) {
+		HardcopyMsg(hardcopies, 0, "Hardcopy stopped: %s", "window is gone");
+		HardcopyNext();
+	}
 }
 
 /*
@@ -333,7 +614,7 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 	 * dump==2:   BUFFERFILE
 	 * dump==1:   scrollback,
 	 */
-	int i, j, k;
+	int i;
 	char *c;
 	FILE *f;
 	char fnbuf[FILENAME_MAX];
@@ -364,9 +645,9 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 				sprintf(fnbuf, "hardcopy.%d", fore->w_number);
 			fn = fnbuf;
 		}
-		if (hardcopy_append && !access(fn, W_OK))
-			mode = "a";
-		break;
+		if (fore)
+			Hardcopy(fn, dump);
+		return;
 	case DUMP_EXCHANGE:
 		if (fn == 0) {
 			strncpy(fnbuf, BufferFile, sizeof(fnbuf) - 1);
@@ -402,37 +683,7 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 		if (f == NULL) {
 			UserReturn(0);
 		} else {
-			uint32_t *p, *pf;
 			switch (dump) {
-			case DUMP_HARDCOPY:
-			case DUMP_SCROLLBACK:
-				if (!fore)
-					break;
-				if (*mode == 'a') {
-					putc('>', f);
-					for (j = fore->w_width - 2; j > 0; j--)
-						putc('=', f);
-					fputs("<\n", f);
-				}
-				if (dump == DUMP_SCROLLBACK) {
-					for (i = 0; i < fore->w_histheight; i++) {
-						p = (WIN(i)->image);
-						pf = WIN(i)->font;
-						for (k = fore->w_width - 1; k >= 0 && p[k] == ' '; k--) ;
-						for (j = 0; j <= k; j++)
-							putc_encoded(f, p[j], pf[j], fore->w_encoding);
-						putc('\n', f);
-					}
-				}
-				for (i = 0; i < fore->w_height; i++) {
-					p = fore->w_mlines[i].image;
-					pf = fore->w_mlines[i].font;
-					for (k = fore->w_width - 1; k >= 0 && p[k] == ' '; k--) ;
-					for (j = 0; j <= k; j++)
-						putc_encoded(f, p[j], pf[j], fore->w_encoding);
-					putc('\n', f);
-				}
-				break;
 			case DUMP_TERMCAP:
 				if ((c = strchr(MakeTermcap(fore->w_aflag), '=')) != NULL) {
 					fputs(++c, f);
@@ -459,10 +710,6 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 		case DUMP_TERMCAP:
 			Msg(0, "Termcap entry written to \"%s\".", fn);
 			break;
-		case DUMP_HARDCOPY:
-		case DUMP_SCROLLBACK:
-			Msg(0, "Screen image %s to \"%s\".", (*mode == 'a') ? "appended" : "written", fn);
-			break;
 		case DUMP_EXCHANGE:
 			Msg(0, "Copybuffer written to \"%s\".", fn);
 		}
@@ -471,33 +718,43 @@ void WriteFile(struct acluser *user, char *fn, int dump)
 
 /*
  * returns an allocated buffer which holds a copy of the file named filename.
- * lenp (if nonzero) points to a location, where the buffer size should be
- * stored.
+ * lenp points to a location, where the buffer size should be stored.
+ * The file is read straight into the buffer, without stdio in between,
+ * so even a very large one is copied only once.
  */
-char *ReadFile(char *filename, int *lenp)
+char *ReadFile(char *filename, size_t *lenp)
 {
-	FILE *file;
-	int l, size;
-	char *buf = NULL;
+	struct stat st;
+	char *buf;
+	size_t l = 0;
+	ssize_t n;
+	int fd;
 
-	if ((file = secfopen(filename, "r")) == NULL) {
+	if ((fd = secopen(filename, O_RDONLY, 0)) < 0) {
 		Msg(errno, "no %s -- no slurp", filename);
 		return NULL;
 	}
-	fseek(file, 0L, SEEK_END);
-	size = ftell(file);
-	if ((buf = malloc(size)) == NULL) {
-		fclose(file);
+	if (fstat(fd, &st)) {
+		Msg(errno, "%s", filename);
+		close(fd);
+		return NULL;
+	}
+	if ((buf = malloc(st.st_size ? (size_t)st.st_size : 1)) == NULL) {
+		close(fd);
 		Msg(0, "%s", strnomem);
 		return NULL;
 	}
-	fseek(file, 0L, SEEK_SET);
 	errno = 0;
-
-	if ((l = fread(buf, sizeof(char), size, file)) != size) {
-		Msg(errno, "Got only %d bytes from %s", l, filename);
+	while (l < (size_t)st.st_size) {
+		if ((n = read(fd, buf + l, st.st_size - l)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		l += n;
 	}
-	fclose(file);
+	if (l != (size_t)st.st_size)
+		Msg(errno, "Got only %zu bytes from %s", l, filename);
+	close(fd);
 	*lenp = l;
 	return buf;
 }
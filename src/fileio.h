@@ -9,7 +9,9 @@ void  RcLine (char *, int);
 FILE *secfopen (char *, char *);
 int   secopen (char *, int, int);
 void  WriteFile (struct acluser *, char *, int);
-char *ReadFile (char *, int *);
+void  HardcopyKeep (Window *);
+void  HardcopyStop (Window *);
+char *ReadFile (char *, size_t *);
 void  KillBuffers (void);
 int   printpipe (Window *, char *);
 int   readpipe (char **);
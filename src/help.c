@@ -79,6 +79,7 @@ void exit_with_usage(char *myname, char *message, char *arg)
 	printf("-q            Quiet startup. Exits with non-zero return code if unsuccessful.\n");
 	printf("-Q            Commands will send the response to the stdout of the querying process.\n");
 	printf("-r [session]  Reattach to a detached screen process.\n");
+	printf("-replay f [s] Play recording f, s times as fast.\n");
 	printf("-R            Reattach if possible, otherwise start a new session.\n");
 	printf("-s shell      Shell to execute rather than $SHELL.\n");
 	printf("-S sockname   Name this session <pid>.sockname instead of <pid>.<tty>.<host>.\n");
@@ -0,0 +1,151 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Scanning helpers for the cell planes of struct mline. The vector
+ * versions are picked at compile time, everything else falls back to
+ * plain loops.
+ */
+
+#include "config.h"
+
+#include "image.h"
+
+#if defined(__GNUC__) && defined(__AVX2__)
+# include <immintrin.h>
+# define VEC_AVX2
+#elif defined(__GNUC__) && defined(__SSE2__)
+# include <emmintrin.h>
+# define VEC_SSE2
+#endif
+
+#if defined(VEC_AVX2)
+# define VEC_CELLS 8
+typedef __m256i vec_t;
+# define VEC_LOAD(p)	_mm256_loadu_si256((const __m256i *)(p))
+# define VEC_SET1(v)	_mm256_set1_epi32((int)(v))
+/* one bit per byte, all four set for cells that are equal */
+# define VEC_EQMASK(a, b) ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)))
+# define VEC_ALLEQ	0xffffffffu
+#elif defined(VEC_SSE2)
+# define VEC_CELLS 4
+typedef __m128i vec_t;
+# define VEC_LOAD(p)	_mm_loadu_si128((const __m128i *)(p))
+# define VEC_SET1(v)	_mm_set1_epi32((int)(v))
+# define VEC_EQMASK(a, b) ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi32(a, b)))
+# define VEC_ALLEQ	0xffffu
+#endif
+
+/* index of the first cell that differs from v, n if there is none */
+int FindNotEq32(const uint32_t *p, uint32_t v, int n)
+{
+	int i = 0;
+#ifdef VEC_CELLS
+	vec_t vv = VEC_SET1(v);
+
+	for (; i + VEC_CELLS <= n; i += VEC_CELLS) {
+		uint32_t m = VEC_EQMASK(VEC_LOAD(p + i), vv);
+		if (m != VEC_ALLEQ)
+			return i + __builtin_ctz(~m) / 4;
+	}
+#endif
+	for (; i < n; i++)
+		if (p[i] != v)
+			return i;
+	return n;
+}
+
+/* index of the last cell that differs from v, -1 if there is none */
+int FindNotEq32Rev(const uint32_t *p, uint32_t v, int n)
+{
+	int i = n;
+#ifdef VEC_CELLS
+	vec_t vv = VEC_SET1(v);
+
+	for (; i >= VEC_CELLS; i -= VEC_CELLS) {
+		uint32_t m = ~VEC_EQMASK(VEC_LOAD(p + i - VEC_CELLS), vv) & VEC_ALLEQ;
+		if (m)
+			return i - VEC_CELLS + (31 - __builtin_clz(m)) / 4;
+	}
+#endif
+	while (--i >= 0)
+		if (p[i] != v)
+			return i;
+	return -1;
+}
+
+/*
+ * A 64 bit set of the characters in the cells, ASCII letters folded to
+ * lower case and blanks left out. A text can only be found in a line
+ * if its set is a subset of the line's.
+ */
+uint64_t CellBloom(const uint32_t *p, int n)
+{
+	uint64_t b = 0;
+
+	for (int i = 0; i < n; i++) {
+		uint32_t c = p[i];
+		if (c == ' ')
+			continue;
+		if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+			c |= 0x20;
+		b |= (uint64_t)1 << ((c * 0x9e3779b1u) >> 26);
+	}
+	return b;
+}
+
+/* index of the first cell where a and b differ, n if there is none */
+int FindDiff32(const uint32_t *a, const uint32_t *b, int n)
+{
+	int i = 0;
+
+	if (a == b)
+		return n;
+#ifdef VEC_CELLS
+	for (; i + VEC_CELLS <= n; i += VEC_CELLS) {
+		uint32_t m = VEC_EQMASK(VEC_LOAD(a + i), VEC_LOAD(b + i));
+		if (m != VEC_ALLEQ)
+			return i + __builtin_ctz(~m) / 4;
+	}
+#endif
+	for (; i < n; i++)
+		if (a[i] != b[i])
+			return i;
+	return n;
+}
+
+/*
+ * First column in from..to where the two lines differ in any plane,
+ * to + 1 if they are the same. Each plane is only searched up to the
+ * earliest difference found so far.
+ */
+int MlineDiff(const struct mline *ml1, const struct mline *ml2, int from, int to)
+{
+	int n = to - from + 1;
+
+	if (n <= 0 || ml1 == ml2)
+		return to + 1;
+	n = FindDiff32(ml1->image + from, ml2->image + from, n);
+	n = FindDiff32(ml1->attr + from, ml2->attr + from, n);
+	n = FindDiff32(ml1->font + from, ml2->font + from, n);
+	n = FindDiff32(ml1->fontx + from, ml2->fontx + from, n);
+	n = FindDiff32(ml1->colorbg + from, ml2->colorbg + from, n);
+	n = FindDiff32(ml1->colorfg + from, ml2->colorfg + from, n);
+	return from + n;
+}
@@ -50,8 +50,22 @@ struct mline {
 	uint32_t *fontx;
 	uint32_t *colorbg;
 	uint32_t *colorfg;
+	uint32_t gen;		/* changes whenever the line does, 0: unknown */
+	uint32_t hash;		/* cached HashMline() of the first hashlen cells */
+	uint32_t hashgen;	/* gen the cached hash belongs to */
+	int hashlen;
+	uint64_t bloom;		/* CellBloom() of the line, for searching */
+	uint32_t bloomgen;	/* gen the bloom belongs to */
 };
 
+int FindNotEq32(const uint32_t *, uint32_t, int);
+int FindNotEq32Rev(const uint32_t *, uint32_t, int);
+uint64_t CellBloom(const uint32_t *, int);
+int FindDiff32(const uint32_t *, const uint32_t *, int);
+int MlineDiff(const struct mline *, const struct mline *, int, int);
+
+/* mark a line as changed, never hands out generation 0 */
+#define touch_mline(ml) ((ml)->gen = ++mline_gen ? mline_gen : ++mline_gen)
 
 
 #define save_mline(ml, n) {					\
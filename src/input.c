@@ -34,6 +34,7 @@
 
 #include "screen.h"
 
+#include "encoding.h"
 #include "misc.h"
 
 #define INPUTLINE (flayer->l_height - 1)
@@ -67,6 +68,17 @@ struct inpdata {
 	char *search;		/* the search string */
 };
 
+/*
+ * In a UTF-8 layer the text is drawn by character and the cursor moves
+ * over whole characters. Other layers have a column per byte.
+ */
+#define INP_UTF8 (flayer->l_encoding == UTF8)
+
+static size_t inp_prevchar(struct inpdata *, size_t);
+static size_t inp_nextchar(struct inpdata *, size_t);
+static int inp_column(struct inpdata *, size_t);
+static int InpPutUtf8(struct inpdata *, int, int, int);
+
 static const struct LayFuncs InpLf = {
 	InpProcess,
 	InpAbort,
@@ -98,7 +110,7 @@ void inp_setprompt(char *p, char *s)
 		inpdata->inp.pos = inpdata->inp.len = strlen(inpdata->inp.buf);
 	}
 	InpRedisplayLine(INPUTLINE, 0, flayer->l_width - 1, 0);
-	flayer->l_x = inpdata->inpstringlen + (inpdata->inpmode & INP_NOECHO ? 0 : inpdata->inp.pos);
+	flayer->l_x = inpdata->inpmode & INP_NOECHO ? (int)inpdata->inpstringlen : inp_column(inpdata, inpdata->inp.pos);
 	flayer->l_y = INPUTLINE;
 }
 
@@ -158,7 +170,7 @@ static void erase_chars(struct inpdata *inpdata, char *from, char *to, int x, in
 		inpdata->inp.pos -= chng;
 	}
 	inpdata->inp.len -= chng;
-	if (!(inpdata->inpmode & INP_NOECHO)) {
+	if (!(inpdata->inpmode & INP_NOECHO) && !INP_UTF8) {
 		struct mchar mc;
 		char *s = from < to ? from : to;
 		mc = mchar_so;
@@ -187,7 +199,7 @@ static void InpProcess(char **ppbuf, size_t *plen)
 
 #define RESET_SEARCH do { if (inpdata->search) Free(inpdata->search); } while (0)
 
-	LGotoPos(flayer, inpdata->inpstringlen + (inpdata->inpmode & INP_NOECHO ? 0 : inpdata->inp.pos), INPUTLINE);
+	LGotoPos(flayer, inpdata->inpmode & INP_NOECHO ? (int)inpdata->inpstringlen : inp_column(inpdata, inpdata->inp.pos), INPUTLINE);
 	if (ppbuf == 0) {
 		InpAbort();
 		return;
@@ -213,13 +225,15 @@ static void InpProcess(char **ppbuf, size_t *plen)
 			if (ch)
 				continue;
 		}
-		if (((unsigned char)ch & 0177) >= ' ' && ch != 0177 && inpdata->inp.len < inpdata->inpmaxlen) {
+		/* the bytes of a UTF-8 character may look like C1 controls */
+		if ((((unsigned char)ch & 0177) >= ' ' || ((unsigned char)ch >= 0x80 && INP_UTF8))
+		    && ch != 0177 && inpdata->inp.len < inpdata->inpmaxlen) {
 			if (inpdata->inp.len > inpdata->inp.pos)
 				memmove(p + 1, p, inpdata->inp.len - inpdata->inp.pos);
 			inpdata->inp.buf[inpdata->inp.pos++] = ch;
 			inpdata->inp.len++;
 
-			if (!(inpdata->inpmode & INP_NOECHO)) {
+			if (!(inpdata->inpmode & INP_NOECHO) && !INP_UTF8) {
 				struct mchar mc;
 				mc = mchar_so;
 				mc.image = *p++;
@@ -236,7 +250,7 @@ static void InpProcess(char **ppbuf, size_t *plen)
 			}
 			RESET_SEARCH;
 		} else if ((ch == '\b' || ch == 0177) && inpdata->inp.pos > 0) {
-			erase_chars(inpdata, p - 1, p, x, 1);
+			erase_chars(inpdata, inpdata->inp.buf + inp_prevchar(inpdata, inpdata->inp.pos), p, x, 1);
 			RESET_SEARCH;
 		} else if (ch == '\025') {	/* CTRL-U */
 			x = inpdata->inpstringlen;
@@ -262,20 +276,20 @@ static void InpProcess(char **ppbuf, size_t *plen)
 			erase_chars(inpdata, p, oldp, x, 1);
 			RESET_SEARCH;
 		} else if (ch == '\004' && inpdata->inp.pos < inpdata->inp.len) {	/* CTRL-D */
-			erase_chars(inpdata, p, p + 1, x, 0);
+			erase_chars(inpdata, p, inpdata->inp.buf + inp_nextchar(inpdata, inpdata->inp.pos), x, 0);
 			RESET_SEARCH;
 		} else if (ch == '\001' || (unsigned char)ch == 0201) {	/* CTRL-A */
 			LGotoPos(flayer, x -= inpdata->inp.pos, INPUTLINE);
 			inpdata->inp.pos = 0;
 		} else if ((ch == '\002' || (unsigned char)ch == 0202) && inpdata->inp.pos > 0) {	/* CTRL-B */
 			LGotoPos(flayer, --x, INPUTLINE);
-			inpdata->inp.pos--;
+			inpdata->inp.pos = inp_prevchar(inpdata, inpdata->inp.pos);
 		} else if (ch == '\005' || (unsigned char)ch == 0205) {	/* CTRL-E */
 			LGotoPos(flayer, x += inpdata->inp.len - inpdata->inp.pos, INPUTLINE);
 			inpdata->inp.pos = inpdata->inp.len;
 		} else if ((ch == '\006' || (unsigned char)ch == 0206) && inpdata->inp.pos < inpdata->inp.len) {	/* CTRL-F */
 			LGotoPos(flayer, ++x, INPUTLINE);
-			inpdata->inp.pos++;
+			inpdata->inp.pos = inp_nextchar(inpdata, inpdata->inp.pos);
 		} else if ((prev = ((ch == '\020' || (unsigned char)ch == 0220) &&	/* CTRL-P */
 				    inpdata->inp.prev)) || (next = ((ch == '\016' || (unsigned char)ch == 0216) &&	/* CTRL-N */
 								    inpdata->inp.next)) ||
@@ -384,8 +398,12 @@ static void InpProcess(char **ppbuf, size_t *plen)
 		}
 	}
 	if (!(inpdata->inpmode & INP_RAW)) {
-		flayer->l_x = inpdata->inpstringlen + (inpdata->inpmode & INP_NOECHO ? 0 : inpdata->inp.pos);
+		flayer->l_x = inpdata->inpmode & INP_NOECHO ? (int)inpdata->inpstringlen : inp_column(inpdata, inpdata->inp.pos);
 		flayer->l_y = INPUTLINE;
+		if (INP_UTF8 && !(inpdata->inpmode & INP_NOECHO)) {
+			InpRedisplayLine(INPUTLINE, inpdata->inpstringlen, flayer->l_width - 1, 0);
+			LGotoPos(flayer, flayer->l_x, INPUTLINE);
+		}
 	}
 	*ppbuf = pbuf;
 	*plen = len;
@@ -422,7 +440,10 @@ static void InpRedisplayLine(int y, int xs, int xe, int isblank)
 	}
 	s = r;
 	r += inpdata->inp.len;
-	if (!(inpdata->inpmode & INP_NOECHO) && v > 0 && q < r) {
+	if (!(inpdata->inpmode & INP_NOECHO) && INP_UTF8) {
+		q = InpPutUtf8(inpdata, q, xe, y);
+		v = xe - q + 1;
+	} else if (!(inpdata->inpmode & INP_NOECHO) && v > 0 && q < r) {
 		l = v;
 		if (l > r - q)
 			l = r - q;
@@ -438,3 +459,64 @@ static void InpRedisplayLine(int y, int xs, int xe, int isblank)
 		LClearArea(flayer, q, y, q + l - 1, y, 0, 0);
 	}
 }
+
+static size_t inp_prevchar(struct inpdata *inpdata, size_t pos)
+{
+	if (pos > 0)
+		pos--;
+	while (INP_UTF8 && pos > 0 && (inpdata->inp.buf[pos] & 0xc0) == 0x80)
+		pos--;
+	return pos;
+}
+
+static size_t inp_nextchar(struct inpdata *inpdata, size_t pos)
+{
+	if (pos < inpdata->inp.len)
+		pos++;
+	while (INP_UTF8 && pos < inpdata->inp.len && (inpdata->inp.buf[pos] & 0xc0) == 0x80)
+		pos++;
+	return pos;
+}
+
+/* the column of byte pos of the text */
+static int inp_column(struct inpdata *inpdata, size_t pos)
+{
+	int x = inpdata->inpstringlen, c, state = 0;
+
+	if (!INP_UTF8)
+		return x + pos;
+	for (size_t i = 0; i < pos; i++) {
+		if ((c = FromUtf8((unsigned char)inpdata->inp.buf[i], &state)) == -1)
+			continue;
+		if (c == -2)
+			i--;
+		x += c >= 0 && utf8_isdouble(c) ? 2 : 1;
+	}
+	return x;
+}
+
+/* draw the text of a UTF-8 layer from column xs to xe, returns the column after it */
+static int InpPutUtf8(struct inpdata *inpdata, int xs, int xe, int y)
+{
+	struct mchar mc = mchar_so;
+	int x = inpdata->inpstringlen, c, w, state = 0;
+
+	for (size_t i = 0; i < inpdata->inp.len && x <= xe; i++) {
+		if ((c = FromUtf8((unsigned char)inpdata->inp.buf[i], &state)) == -1)
+			continue;
+		if (c == -2) {
+			c = UCS_REPL;
+			i--;
+		}
+		w = utf8_isdouble(c) ? 2 : 1;
+		if (x >= xs && x + w - 1 <= xe) {
+			mc.image = c;
+			mc.font = c >> 8 & 0xff;
+			mc.fontx = c >> 16 & 0xff;
+			mc.mbcs = w == 2 ? 0xff : 0;
+			LPutChar(flayer, &mc, x, y);
+		}
+		x += w;
+	}
+	return x > xs ? x : xs;
+}
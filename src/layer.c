@@ -147,13 +147,22 @@ void LScrollH(Layer *l, int n, int y, int xs, int xe, int bce, struct mline *ol)
 void LScrollV(Layer *l, int n, int ys, int ye, int bce)
 {
 	int ys2, ye2, xs2, xe2;
+	DisplayShare ds;
+
 	if (n == 0)
 		return;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, 0, l->l_width - 1, ys, ye);
+	DisplayShareInit(&ds);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
 		if (l->l_pause.d && cv->c_slorient)
 			continue;
+		display = cv->c_display;
+		if (D_blocked)
+			continue;
+		if (DisplayShareCopy(&ds, cv))
+			continue;
+		DisplayShareBegin(&ds, cv);
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			xs2 = vp->v_xoff;
 			xe2 = l->l_width - 1 + vp->v_xoff;
@@ -169,9 +178,6 @@ void LScrollV(Layer *l, int n, int ys, int ye, int bce)
 				ye2 = vp->v_ye;
 			if (ys2 > ye2 || xs2 > xe2)
 				continue;
-			display = cv->c_display;
-			if (D_blocked)
-				continue;
 			ScrollV(vp->v_xs, ys2, vp->v_xe, ye2, n, bce);
 			if (ye2 - ys2 == ye - ys)
 				continue;
@@ -189,6 +195,7 @@ void LScrollV(Layer *l, int n, int ys, int ye, int bce)
 			if (ys2 <= ye2)
 				RefreshArea(xs2, ys2, xe2, ye2, 1);
 		}
+		DisplayShareEnd(&ds);
 	}
 }
 
@@ -242,17 +249,22 @@ void LInsChar(Layer *l, struct mchar *c, int x, int y, struct mline *ol)
 void LPutChar(Layer *l, struct mchar *c, int x, int y)
 {
 	int x2, y2;
+	DisplayShare ds;
 
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, x, x + (c->mbcs ? 1 : 0)
 				     , y, y);
 
+	DisplayShareInit(&ds);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
 		if (l->l_pause.d && cv->c_slorient)
 			continue;
 		display = cv->c_display;
 		if (D_blocked)
 			continue;
+		if (DisplayShareCopy(&ds, cv))
+			continue;
+		DisplayShareBegin(&ds, cv);
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
 			if (y2 < vp->v_ys || y2 > vp->v_ye)
@@ -263,6 +275,7 @@ void LPutChar(Layer *l, struct mchar *c, int x, int y)
 			PutChar(RECODE_MCHAR(c), x2, y2);
 			break;
 		}
+		DisplayShareEnd(&ds);
 	}
 }
 
@@ -270,15 +283,23 @@ void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 {
 	char *s2;
 	int xs2, xe2, y2;
+	DisplayShare ds;
 
 	if (x + n > l->l_width)
 		n = l->l_width - x;
 	if (l->l_pause.d)
 		LayPauseUpdateRegion(l, x, x + n - 1, y, y);
 
+	DisplayShareInit(&ds);
 	for (Canvas *cv = l->l_cvlist; cv; cv = cv->c_lnext) {
 		if (l->l_pause.d && cv->c_slorient)
 			continue;
+		display = cv->c_display;
+		if (D_blocked)
+			continue;
+		if (DisplayShareCopy(&ds, cv))
+			continue;
+		DisplayShareBegin(&ds, cv);
 		for (Viewport *vp = cv->c_vplist; vp; vp = vp->v_next) {
 			y2 = y + vp->v_yoff;
 			if (y2 < vp->v_ys || y2 > vp->v_ye)
@@ -291,9 +312,6 @@ void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 				xe2 = vp->v_xe;
 			if (xs2 > xe2)
 				continue;
-			display = cv->c_display;
-			if (D_blocked)
-				continue;
 			GotoPos(xs2, y2);
 			SetRendition(r);
 			s2 = s + xs2 - x - vp->v_xoff;
@@ -309,6 +327,7 @@ void LPutStr(Layer *l, char *s, int n, struct mchar *r, int x, int y)
 			while (xs2++ <= xe2)
 				PUTCHARLP(*s2++);
 		}
+		DisplayShareEnd(&ds);
 	}
 }
 
@@ -925,6 +944,21 @@ void LayProcessMouseSwitch(Layer *l, bool start)
 	}
 }
 
+static void LayPauseSaveGens(Layer *layer, Window *win)
+{
+	if (layer->l_pause.genlines < win->w_height) {
+		uint32_t *gen = realloc(layer->l_pause.gen, sizeof(uint32_t) * win->w_height);
+		if (!gen) {
+			layer->l_pause.genlines = 0;
+			return;
+		}
+		layer->l_pause.gen = gen;
+	}
+	layer->l_pause.genlines = win->w_height;
+	for (int y = 0; y < win->w_height; y++)
+		layer->l_pause.gen[y] = win->w_mlines[y].gen;
+}
+
 void LayPause(Layer *layer, bool pause)
 {
 	Window *win;
@@ -935,6 +969,8 @@ void LayPause(Layer *layer, bool pause)
 	if ((layer->l_pause.d = pause)) {
 		/* Start pausing */
 		layer->l_pause.top = layer->l_pause.bottom = -1;
+		if (layer->l_layfn == &WinLf)
+			LayPauseSaveGens(layer, layer->l_data);
 		return;
 	}
 
@@ -957,6 +993,9 @@ void LayPause(Layer *layer, bool pause)
 			for (int line = layer->l_pause.top; line <= layer->l_pause.bottom; line++) {
 				int xs, xe;
 
+				if (win && line < layer->l_pause.genlines && line < win->w_height &&
+				    layer->l_pause.gen[line] && layer->l_pause.gen[line] == win->w_mlines[line].gen)
+					continue;	/* unchanged since pausing */
 				if (line + vp->v_yoff >= vp->v_ys && line + vp->v_yoff <= vp->v_ye &&
 				    ((xs = layer->l_pause.left[line]) >= 0) &&
 				    ((xe = layer->l_pause.right[line]) >= 0)) {
@@ -1043,4 +1082,6 @@ void LayerCleanupMemory(Layer *layer)
 		free(layer->l_pause.left);
 	if (layer->l_pause.right)
 		free(layer->l_pause.right);
+	if (layer->l_pause.gen)
+		free(layer->l_pause.gen);
 }
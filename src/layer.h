@@ -31,6 +31,7 @@
 #define SCREEN_LAYER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /*
@@ -86,6 +87,11 @@ struct Layer {
 		int *left, *right;
 		int top, bottom;
 		int lines;
+
+		/* Line generations when pausing started, lines still
+		 * carrying theirs need no refresh. */
+		uint32_t *gen;
+		int genlines;
 	} l_pause;
 };
 
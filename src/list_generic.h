@@ -75,6 +75,8 @@ void display_displays (void);
 
 void display_windows (int onblank, int order, Window *group);
 
+void display_grep (char *pattern);
+
 /* global variables */
 
 extern const struct LayFuncs ListLf;
@@ -0,0 +1,416 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Deals with the list of lines grep finds in the windows. The search
+ * runs from the event loop a slice at a time, a few hundred lines of a
+ * window at a time, so input and output are served while it goes on.
+ * Lines that move up into the history in between are followed with
+ * w_histcount, so they are neither missed nor found twice.
+ */
+
+#include "config.h"
+
+#include "list_generic.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "screen.h"
+
+#include "encoding.h"
+#include "input.h"
+#include "mark.h"
+#include "misc.h"
+#include "process.h"
+#include "search.h"
+#include "winmsg.h"
+
+static char ListID[] = "grep";
+
+#define GREP_SLICE 10		/* milliseconds of searching at a time */
+#define GREP_ROWS 256		/* lines searched between looks at the clock */
+#define GREP_MAXHITS 10000
+#define GREP_CONTEXT 16		/* characters shown before a match */
+
+struct gl_Grep_Hit {
+	Window *win;		/* only compared, the window may be gone */
+	int wnum;
+	uint32_t gen;		/* the line, as long as it is not changed */
+	int y, x, len;
+	int line;		/* counted from the top of the screen */
+	bool utf8;
+	int n;
+	uint32_t *text;		/* the characters of the line */
+};
+
+struct gl_Grep_Data {
+	char *pattern;
+	struct acluser *user;
+	Layer *layer;
+	int next;		/* number of the next window to search */
+	Window *win;		/* the window in it when we started on it */
+	int row;		/* its next line, 0 if not started */
+	uint64_t histcount;	/* its w_histcount when row was taken */
+	int windows;		/* windows with a match */
+	int hits;
+	bool bad;
+	ListRow *last;
+	Event ev;		/* a slice every time around the loop */
+	Event wake;		/* and one when there is nothing else to do */
+};
+
+static int gl_Grep_hit(Window *, struct mline *, int, int, int, void *);
+static void gl_Grep_run(Event *, void *);
+static int GrepLocate(Window *, uint32_t, int);
+static void GrepJump(Window *, int, uint32_t, int, int);
+static void GrepFin(char *, size_t, void *);
+
+static int gl_Grep_header(ListData *ldata)
+{
+	(void)ldata; /* unused */
+
+	leftline("Num Name           Line  Text", 0, 0);
+	leftline("--- ------------ ------  ----", 1, 0);
+	return 2;
+}
+
+static int gl_Grep_footer(ListData *ldata)
+{
+	struct gl_Grep_Data *gd = ldata->data;
+	char str[MAXSTR];
+
+	if (gd->bad)
+		snprintf(str, sizeof(str), "[Bad regular expression. Press Escape to end.]");
+	else if (gd->next < maxwin)
+		snprintf(str, sizeof(str), "[Searching window %d: %d lines in %d windows so far]",
+			 gd->next, gd->hits, gd->windows);
+	else
+		snprintf(str, sizeof(str), "[%d%s lines in %d windows. Return to copy mode at a line.]",
+			 gd->hits, gd->hits >= GREP_MAXHITS ? "+" : "", gd->windows);
+	centerline(str, flayer->l_height - 1);
+	return 1;
+}
+
+static int gl_Grep_row(ListData *ldata, ListRow *lrow)
+{
+	struct gl_Grep_Hit *hit = lrow->data;
+	struct mchar mc = lrow == ldata->selected ? mchar_so : mchar_blank;
+	struct mchar mm;
+	Window *p = hit->wnum < maxwin && wtab[hit->wnum] == hit->win ? hit->win : NULL;
+	char tbuf[64];
+	int x, i, w, room;
+
+	snprintf(tbuf, sizeof(tbuf), "%3d %-12.12s %6d  ", hit->wnum, p ? p->w_title : "", hit->line);
+	leftline(tbuf, lrow->y, &mc);
+	x = strlen(tbuf);
+	if (x >= flayer->l_width - 1)
+		return 1;
+
+	/* show some text before the match, but all of the match if it fits */
+	room = flayer->l_width - x;
+	i = hit->x > GREP_CONTEXT ? hit->x - GREP_CONTEXT : 0;
+	if (hit->x + hit->len - i > room)
+		i = hit->x + hit->len - room < hit->x ? hit->x + hit->len - room : hit->x;
+	if (i > 0 && hit->text[i] == UCS_HIDDEN)
+		i--;
+	for (; i < hit->n && x < flayer->l_width; i++) {
+		uint32_t c = hit->text[i];
+
+		if (hit->utf8 && c == UCS_HIDDEN)
+			continue;
+		w = hit->utf8 && utf8_isdouble(c) ? 2 : 1;
+		if (x + w > flayer->l_width)
+			break;
+		mm = mc;
+		if (i >= hit->x && i < hit->x + hit->len)
+			mm.attr |= A_BD;
+		mm.image = c;
+		mm.font = c >> 8 & 0xff;
+		mm.fontx = c >> 16 & 0xff;
+		mm.mbcs = w == 2 ? 0xff : 0;
+		LPutChar(flayer, &mm, x, lrow->y);
+		x += w;
+	}
+	if (x < flayer->l_width)
+		LClearArea(flayer, x, lrow->y, flayer->l_width - 1, lrow->y, 0, 0);
+	return 1;
+}
+
+static int gl_Grep_input(ListData *ldata, char **inp, size_t *len)
+{
+	struct gl_Grep_Hit *hit;
+	unsigned char ch;
+
+	ch = (unsigned char)**inp;
+	if (ldata->selected ? ch != '\r' && ch != '\n' : ch != 033 && ch != 007)
+		return 0;
+	++*inp;
+	--*len;
+	if (!ldata->selected) {
+		glist_abort();
+		*len = 0;
+		return 1;
+	}
+	hit = ldata->selected->data;
+	{
+		Window *win = hit->win;
+		int wnum = hit->wnum, y = hit->y, x = hit->x;
+		uint32_t gen = hit->gen;
+		Display *cd = display;
+
+		glist_abort();
+		display = cd;
+		*len = 0;
+		GrepJump(win, wnum, gen, y, x);
+	}
+	return 1;
+}
+
+static int gl_Grep_freerow(ListData *ldata, ListRow *row)
+{
+	struct gl_Grep_Hit *hit = row->data;
+
+	(void)ldata; /* unused */
+
+	free(hit->text);
+	free(hit);
+	return 0;
+}
+
+static int gl_Grep_free(ListData *ldata)
+{
+	struct gl_Grep_Data *gd = ldata->data;
+
+	evdeq(&gd->ev);
+	evdeq(&gd->wake);
+	free(gd->pattern);
+	free(gd);
+	return 0;
+}
+
+static int gl_Grep_match(ListData *ldata, ListRow *row, const char *needle)
+{
+	struct gl_Grep_Hit *hit = row->data;
+
+	(void)ldata; /* unused */
+
+	if (hit->wnum < maxwin && wtab[hit->wnum] == hit->win && strstr(hit->win->w_title, needle))
+		return 1;
+	return 0;
+}
+
+static GenericList gl_Grep = {
+	gl_Grep_header,
+	gl_Grep_footer,
+	gl_Grep_row,
+	gl_Grep_input,
+	gl_Grep_freerow,
+	gl_Grep_free,
+	gl_Grep_match
+};
+
+/* called by SearchWindow() with the first match of a line */
+static int gl_Grep_hit(Window *p, struct mline *ml, int y, int x, int len, void *data)
+{
+	ListData *ldata = data;
+	struct gl_Grep_Data *gd = ldata->data;
+	struct gl_Grep_Hit *hit;
+	int n;
+
+	if (!(hit = calloc(1, sizeof(*hit))) || !(hit->text = malloc(p->w_width * sizeof(uint32_t)))) {
+		free(hit);
+		return 1;
+	}
+	hit->utf8 = p->w_encoding == UTF8;
+	for (n = 0; n < p->w_width; n++)
+		hit->text[n] = hit->utf8 ? (ml->image[n] & 0xff) | (ml->font[n] & 0xff) << 8
+		    | (ml->fontx[n] & 0xff) << 16 : ml->image[n];
+	while (n > 0 && hit->text[n - 1] == ' ')
+		n--;
+	hit->n = n;
+	hit->win = p;
+	hit->wnum = p->w_number;
+	hit->gen = ml->gen;
+	hit->y = y;
+	hit->line = y - p->w_histheight + 1;
+	hit->x = x;
+	hit->len = len;
+	if (!gd->last || ((struct gl_Grep_Hit *)gd->last->data)->win != p)
+		gd->windows++;
+	gd->last = glist_add_row(ldata, hit, gd->last);
+	return ++gd->hits >= GREP_MAXHITS;
+}
+
+static void gl_Grep_run(Event *ev, void *data)
+{
+	ListData *ldata = data;
+	struct gl_Grep_Data *gd = ldata->data;
+	struct timeval start, now;
+	Layer *oldflayer = flayer;
+	Display *olddisplay = display;
+	int hits = gd->hits;
+	Window *p;
+
+	(void)ev; /* unused */
+
+	gettimeofday(&start, NULL);
+	while (gd->next < maxwin) {
+		int row = 0;
+
+		p = wtab[gd->next];
+		if (p && p == gd->win && gd->row) {
+			/* the lines searched so far may have moved up */
+			uint64_t pushed = p->w_histcount - gd->histcount;
+			row = pushed < (uint64_t)gd->row ? gd->row - (int)pushed : 0;
+		}
+		if (p && !AclCheckPermWin(gd->user, ACL_READ, p)
+		    && (row = SearchWindow(p, gd->pattern, row, GREP_ROWS, gl_Grep_hit, ldata)) < 0) {
+			gd->bad = true;
+			break;
+		}
+		if (p && row > 0) {
+			gd->win = p;
+			gd->row = row;
+			gd->histcount = p->w_histcount;
+		} else {
+			gd->next++;
+			gd->win = NULL;
+			gd->row = 0;
+		}
+		if (gd->hits >= GREP_MAXHITS)
+			break;
+		gettimeofday(&now, NULL);
+		if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000 >= GREP_SLICE)
+			break;
+	}
+	if (gd->bad || gd->hits >= GREP_MAXHITS)
+		gd->next = maxwin;
+	if (gd->next < maxwin) {
+		SetTimeout(&gd->wake, 0);
+		evenq(&gd->wake);
+	} else {
+		evdeq(&gd->ev);
+		evdeq(&gd->wake);
+	}
+
+	flayer = gd->layer;
+	if (hits != gd->hits || gd->next >= maxwin)
+		glist_display_all(ldata);
+	else {
+		LClearArea(flayer, 0, flayer->l_height - 1, flayer->l_width - 1, flayer->l_height - 1, 0, 0);
+		gl_Grep_footer(ldata);
+		LaySetCursor();
+	}
+	flayer = oldflayer;
+	display = olddisplay;
+}
+
+/* where line y of window p with generation gen is now, -1 if it is gone */
+static int GrepLocate(Window *p, uint32_t gen, int y)
+{
+	struct mline *ml;
+
+	if (gen == 0)
+		return y < p->w_histheight + p->w_height ? y : -1;
+	/* new history pushes lines towards the top */
+	for (y = y < p->w_histheight + p->w_height ? y : p->w_histheight + p->w_height - 1; y >= 0; y--) {
+		if (y < p->w_histheight)
+			ml = &p->w_hlines[(p->w_histidx + y) % p->w_histheight];
+		else
+			ml = &p->w_mlines[y - p->w_histheight];
+		if (ml->gen == gen)
+			return y;
+	}
+	return -1;
+}
+
+static void GrepJump(Window *win, int wnum, uint32_t gen, int y, int x)
+{
+	int ny;
+
+	if (wnum >= maxwin || wtab[wnum] != win) {
+		Msg(0, "Window %d is gone", wnum);
+		return;
+	}
+	if (D_fore != win)
+		SwitchWindow(wnum);
+	if (D_fore != win || flayer->l_layfn != &WinLf) {
+		Msg(0, "Must be on a window layer");
+		return;
+	}
+	MarkRoutine();
+	WindowChanged(fore, WINESC_COPY_MODE);
+	if ((ny = GrepLocate(win, gen, y)) >= 0)
+		revto(x, ny);
+	else
+		LMsg(0, "The line has changed since the search");
+}
+
+static void GrepFin(char *buf, size_t len, void *data)
+{
+	(void)data; /* unused */
+
+	if (len)
+		display_grep(buf);
+}
+
+/* Search all windows for pattern, asking for it if there is none. */
+void display_grep(char *pattern)
+{
+	ListData *ldata;
+	struct gl_Grep_Data *gd;
+
+	if (!pattern || !*pattern) {
+		Input("grep: ", MAXSTR - 1, INP_COOKED, GrepFin, NULL, 0);
+		/* take the pattern in the encoding of the window */
+		if (fore)
+			flayer->l_encoding = fore->w_encoding;
+		return;
+	}
+	if (flayer->l_width < 10 || flayer->l_height < 5) {
+		LMsg(0, "Window size too small for grep page");
+		return;
+	}
+	ldata = glist_display(&gl_Grep, ListID);
+	if (!ldata)
+		return;
+	if (!(gd = calloc(1, sizeof(*gd)))) {
+		glist_abort();
+		return;
+	}
+	gd->pattern = SaveStr(pattern);
+	/* the rows show characters, not bytes */
+	flayer->l_encoding = UTF8;
+	ldata->data = gd;
+	gd->layer = flayer;
+	gd->user = D_user;
+	gd->ev.type = EV_ALWAYS;
+	gd->ev.handler = gl_Grep_run;
+	gd->ev.data = (char *)ldata;
+	evenq(&gd->ev);
+	gd->wake.type = EV_TIMEOUT;
+	gd->wake.handler = gl_Grep_run;
+	gd->wake.data = (char *)ldata;
+	SetTimeout(&gd->wake, 0);
+	evenq(&gd->wake);
+	glist_display_all(ldata);
+}
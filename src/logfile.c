@@ -32,30 +32,45 @@
 
 #include <sys/types.h>		/* dev_t, ino_t, off_t, ... */
 #include <sys/stat.h>		/* struct stat */
+#include <sys/resource.h>	/* setpriority */
 #include <fcntl.h>		/* O_WRONLY for logfile_reopen */
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "screen.h"
 
 #include "misc.h"
 
+/*
+ * Writes are collected per logfile and go out in one write() when the
+ * buffer is full or logfflush() is called, normally from the log flush
+ * timer. The file is checked for rotation at most once a second.
+ */
+#define LOG_BUFSIZE	(64 * 1024)
+#define LOG_CHECKINTERVAL 1	/* seconds */
+
 static void changed_logfile(Log *);
 static Log *lookup_logfile(char *);
 static int stolen_logfile(Log *);
+static int logfile_out(Log *, char *, size_t);
+static void segname(char *, size_t, Log *, int, bool);
+static bool segbusy(Log *);
 
 static Log *logroot = NULL;
 
+off_t log_maxsize = 0;
+int log_maxage = 0;
+int log_keep = 5;
+bool log_compress = false;
+int log_text = LOG_TEXT_OFF;
+
+/* remember how the file looks now */
 static void changed_logfile(Log *l)
 {
-	struct stat o, *s = l->st;
-
-	if (fstat(fileno(l->fp), &o) < 0)	/* get trouble later */
-		return;
-	if (o.st_size > s->st_size) {	/* aha, appended text */
-		s->st_size = o.st_size;	/* this should have changed */
-		s->st_mtime = o.st_mtime;	/* only size and mtime */
-	}
+	if (fstat(fileno(l->fp), l->st) < 0)	/* get trouble later */
+		l->st->st_ino = l->st->st_dev = 0;
+	l->checked = time(NULL);
 }
 
 /*
@@ -83,25 +98,29 @@ static int logfile_reopen(char *name, int wantfd, Log *l)
 	int got_fd;
 
 	close(wantfd);
-	if (((got_fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0666)) < 0) || lf_move_fd(got_fd, wantfd) < 0) {
+	if (UserContext() > 0)
+		UserReturn(open(name, O_WRONLY | O_CREAT | O_APPEND, 0666));
+	if (((got_fd = UserStatus()) < 0) || lf_move_fd(got_fd, wantfd) < 0) {
 		logfclose(l);
 		return -1;
 	}
 	changed_logfile(l);
-	l->st->st_ino = l->st->st_dev = 0;
 	return 0;
 }
 
 /*
- * If the logfile has been removed, truncated, unlinked or the like,
- * return nonzero.
- * The l->st structure initialised by logfopen is updated
- * on every call.
+ * If the logfile has been removed, truncated, renamed or the like,
+ * return nonzero. Between checks l->st->st_size is advanced by what
+ * we write ourselves, so only a shrinking file looks truncated.
  */
 static int stolen_logfile(Log *l)
 {
-	struct stat o, *s = l->st;
+	struct stat o, n, *s = l->st;
+	time_t now = time(NULL);
 
+	if (now >= l->checked && now - l->checked < LOG_CHECKINTERVAL)
+		return 0;
+	l->checked = now;
 	o = *s;
 	if (fstat(fileno(l->fp), s) < 0)	/* remember that stat failed */
 		s->st_ino = s->st_dev = 0;
@@ -111,12 +130,9 @@ static int stolen_logfile(Log *l)
 	if ((!s->st_dev && !s->st_ino) ||	/* stat failed, that's new! */
 	    !s->st_nlink ||	/* red alert: file unlinked */
 	    (s->st_size < o.st_size) ||	/*           file truncated */
-	    (s->st_mtime != o.st_mtime) ||	/*            file modified */
-	    ((s->st_ctime != o.st_ctime) &&	/*     file changed (moved) */
-	     !(s->st_mtime == s->st_ctime &&	/*  and it was not a change */
-	       o.st_ctime < s->st_ctime))) {	/* due to delayed nfs write */
+	    stat(l->name, &n) < 0 ||	/*    name gone, or it now */
+	    n.st_dev != s->st_dev || n.st_ino != s->st_ino)	/* is another file */
 		return -1;
-	}
 
 	return 0;
 }
@@ -155,6 +171,7 @@ Log *logfopen(char *name, FILE * fp)
 		return NULL;
 	}
 	l->fp = fp;
+	l->opened = time(NULL);
 	l->opencount = 1;
 	l->writecount = 0;
 	l->flushcount = 0;
@@ -189,47 +206,159 @@ int logfclose(Log *l)
 		abort();
 
 	*lp = l->next;
+	if (l->buflen)
+		logfile_out(l, l->buf, l->buflen);
 	fclose(l->fp);
+	free(l->buf);
 	free(l->name);
+	free(l->st);
 	free((char *)l);
 	return 0;
 }
 
-/*
- * XXX
- * write and flush both *should* check the file's stat, if it disappeared
- * or changed, re-open it.
- */
-int logfwrite(Log *l, char *buf, size_t n)
+/* write n bytes to the file, reopening it first if it was rotated */
+static int logfile_out(Log *l, char *buf, size_t n)
 {
-	int r;
+	ssize_t r;
 
+	l->buflen = 0;
 	if (stolen_logfile(l) && logfile_reopen(l->name, fileno(l->fp), l))
 		return -1;
-	r = fwrite(buf, n, 1, l->fp);
+	while (n > 0) {
+		if ((r = write(fileno(l->fp), buf, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += r;
+		n -= r;
+		l->st->st_size += r;
+	}
+	return 0;
+}
+
+int logfwrite(Log *l, char *buf, size_t n)
+{
 	l->writecount += l->flushcount + 1;
 	l->flushcount = 0;
-	changed_logfile(l);
-	return r;
+	if (!l->buf && !(l->buf = malloc(LOG_BUFSIZE)))
+		return logfile_out(l, buf, n) ? -1 : 1;
+	if (l->buflen + n > LOG_BUFSIZE && logfile_out(l, l->buf, l->buflen))
+		return -1;
+	if (n >= LOG_BUFSIZE)
+		return logfile_out(l, buf, n) ? -1 : 1;
+	memmove(l->buf + l->buflen, buf, n);
+	l->buflen += n;
+	return 1;
 }
 
 int logfflush(Log *l)
 {
+	Log *next;
 	int r = 0;
 
 	if (!l)
-		for (l = logroot; l; l = l->next) {
-			if (stolen_logfile(l) && logfile_reopen(l->name, fileno(l->fp), l))
-				return -1;
-			r |= fflush(l->fp);
+		for (l = logroot; l; l = next) {
+			next = l->next;
 			l->flushcount++;
-			changed_logfile(l);
+			r |= logfile_out(l, l->buf, l->buflen);
 	} else {
-		if (stolen_logfile(l) && logfile_reopen(l->name, fileno(l->fp), l))
-			return -1;
-		r = fflush(l->fp);
 		l->flushcount++;
-		changed_logfile(l);
+		r = logfile_out(l, l->buf, l->buflen);
 	}
 	return r;
 }
+
+bool logfrotatedue(Log *l)
+{
+	if (!(log_maxsize && l->st->st_size + (off_t)l->buflen >= log_maxsize)
+	    && !(log_maxage && time(NULL) - l->opened >= log_maxage))
+		return false;
+	/* let the last compressor finish before its file gets renamed */
+	return l->zpid <= 0 && !segbusy(l);
+}
+
+void logfreaped(pid_t pid)
+{
+	for (Log *l = logroot; l; l = l->next)
+		if (l->zpid == pid)
+			l->zpid = 0;
+}
+
+/* name of segment i of l, with the compressor's suffix if z */
+static void segname(char *buf, size_t len, Log *l, int i, bool z)
+{
+	snprintf(buf, len, "%s.%d%s", l->name, i, z ? ".gz" : "");
+}
+
+/* is a segment name open as another log or a recording? Never move those. */
+static bool segbusy(Log *l)
+{
+	char name[MAXPATHLEN];
+
+	for (int z = 0; z < 2; z++)
+		for (int i = 1; i <= log_keep; i++) {
+			segname(name, sizeof(name), l, i, z);
+			if (lookup_logfile(name))
+				return true;
+		}
+	return false;
+}
+
+int logfrotate(Log *l)
+{
+	char from[MAXPATHLEN], to[MAXPATHLEN];
+
+	if (l->buflen && logfile_out(l, l->buf, l->buflen)) {
+		int e = errno;
+		logfclose(l);
+		errno = e;
+		return -1;
+	}
+	/* the names are the user's choice, move them with the user's rights */
+	if (UserContext() > 0) {
+		if (log_keep > 0) {
+			for (int z = 0; z < 2; z++) {
+				segname(to, sizeof(to), l, log_keep, z);
+				unlink(to);
+				for (int i = log_keep - 1; i > 0; i--) {
+					segname(from, sizeof(from), l, i, z);
+					segname(to, sizeof(to), l, i + 1, z);
+					rename(from, to);
+				}
+			}
+			segname(to, sizeof(to), l, 1, false);
+			UserReturn(rename(l->name, to) == 0);
+		} else {
+			unlink(l->name);
+			UserReturn(0);
+		}
+	}
+	if (UserStatus() && log_compress)
+		l->zpid = logfcompress(to);
+	if (logfile_reopen(l->name, fileno(l->fp), l))
+		return -1;
+	l->opened = time(NULL);
+	return 0;
+}
+
+pid_t logfcompress(char *name)
+{
+	char *argv[] = { "gzip", "-f", name, NULL };
+	pid_t pid;
+
+	switch (pid = fork()) {
+	case -1:
+		return -1;
+	case 0:
+		displays = 0;
+		closeallfiles(-1);
+		if (setgid(real_gid) || setuid(real_uid))
+			_exit(1);
+		setpriority(PRIO_PROCESS, 0, 10);	/* stay out of the way */
+		execvp(*argv, argv);
+		_exit(1);
+	default:
+		return pid;
+	}
+}
@@ -30,7 +30,10 @@
 #ifndef SCREEN_LOGFILE_H
 #define SCREEN_LOGFILE_H
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
 
 typedef struct Log Log;
 struct Log {
@@ -41,8 +44,32 @@ struct Log {
 	int writecount;	/* increments at logfwrite(), counts write() and fflush() */
 	int flushcount;	/* increments at logfflush(), zeroed at logfwrite() */
 	struct stat *st;/* how the file looks like */
+	char *buf;	/* written data not yet passed to the file */
+	size_t buflen;
+	time_t checked;	/* when st was last compared with the file */
+	time_t opened;	/* when the current segment was started */
+	pid_t zpid;	/* compressor of the last segment */
 };
 
+/*
+ * Rotation policy, set with the logfile command. A log is rotated once
+ * it reaches log_maxsize bytes or log_maxage seconds, 0 turns either
+ * off. log_keep old segments are kept as name.1 ... name.N, gzipped in
+ * the background if log_compress is set.
+ */
+extern off_t log_maxsize;
+extern int log_maxage;
+extern int log_keep;
+extern bool log_compress;
+
+/*
+ * What goes into window logs: the raw output (LOG_TEXT_OFF), or the
+ * text of lines as they scroll off the screen, optionally prefixed
+ * with the time.
+ */
+enum { LOG_TEXT_OFF, LOG_TEXT_ON, LOG_TEXT_STAMP };
+extern int log_text;
+
 /*
  * open a logfile, The second argument must be NULL, when the named file
  * is already a logfile or must be a appropriatly opened file pointer
@@ -64,6 +91,18 @@ int islogfile (char *name);
 int logfclose (Log *);
 int logfwrite (Log *, char *, size_t);
 
+/*
+ * logfrotatedue tells if the policy wants l rotated now, logfrotate
+ * moves the file aside and starts over with an empty one under the
+ * same name. If that fails, l is logfclose()d. logfcompress gzips a
+ * finished segment in the background, logfreaped is told when such a
+ * child has exited.
+ */
+bool logfrotatedue (Log *l);
+int logfrotate (Log *l);
+pid_t logfcompress (char *name);
+void logfreaped (pid_t pid);
+
 /*
  * logfflush should be called periodically. If no argument is passed,
  * all logfiles are flushed, else the specified file
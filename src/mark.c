@@ -31,6 +31,15 @@
 #include "mark.h"
 
 #include <sys/types.h>
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -40,6 +49,8 @@
 
 #include "encoding.h"
 #include "fileio.h"
+#include "input.h"
+#include "misc.h"
 #include "process.h"
 #include "search.h"
 #include "winmsg.h"
@@ -53,10 +64,19 @@
  * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
  */
 
+/* a region of a window, as copy mode copies it */
+struct region {
+	Window *win;
+	int x1, y1, x2, y2;	/* first and last cell */
+	int left_mar, right_mar, nonl;
+};
+
 static int is_letter(int);
 static void nextword(int *, int *, int, int);
 static int linestart(int);
 static int lineend(int);
+static int rem_cols(struct region *, struct mline *, int, int *);
+static int rem_line(struct region *, struct mline *, int, char *);
 static int rem(int, int, int, int, int, char *, int);
 static bool eq(int, int);
 static int MarkScrollDownDisplay(int);
@@ -65,6 +85,7 @@ static int MarkScrollUpDisplay(int);
 static void MarkProcess(char **, size_t *);
 static void MarkAbort(void);
 static void MarkRedisplayLine(int, int, int, int);
+static void MarkShowMatches(struct mline *, int, int, int, int);
 
 bool compacthist = false;
 bool join_with_cr = false;
@@ -84,6 +105,10 @@ unsigned char mark_key_tab[256];	/* this array must be initialised first! */
 
 static struct markdata *markdata;
 
+struct export;
+static struct export *ExportNew(int, int, int, int);
+static void ExportFin(char *, size_t, void *);
+
 /*
  * VI like is_letter: 0 - whitespace
  *                    1 - letter
@@ -102,13 +127,11 @@ static int is_letter(int c)
 
 static int linestart(int y)
 {
-	int x;
-	uint32_t *i;
+	int x = markdata->left_mar;
 
-	for (x = markdata->left_mar, i = WIN(y)->image + x; x < fore->w_width - 1; x++)
-		if (*i++ != ' ')
-			break;
-	if (x == fore->w_width - 1)
+	if (x < fore->w_width - 1)
+		x += FindNotEq32(WIN(y)->image + x, ' ', fore->w_width - 1 - x);
+	if (x >= fore->w_width - 1)
 		x = markdata->left_mar;
 	return x;
 }
@@ -116,11 +139,8 @@ static int linestart(int y)
 static int lineend(int y)
 {
 	int x;
-	uint32_t *i;
 
-	for (x = markdata->right_mar, i = WIN(y)->image + x; x >= 0; x--)
-		if (*i-- != ' ')
-			break;
+	x = FindNotEq32Rev(WIN(y)->image, ' ', markdata->right_mar + 1);
 	if (x < 0)
 		x = markdata->left_mar;
 	return x;
@@ -237,15 +257,124 @@ static void nextword(int *xp, int *yp, int flags, int num)
  *		2  -  count + copy, don't redisplay
  */
 
-static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend)
+/* the columns of line i of the region that are copied, in *fromp and the return value */
+static int rem_cols(struct region *r, struct mline *ml, int i, int *fromp)
+{
+	int from, to;
+	uint32_t *im;
+
+	from = (i == r->y1) ? r->x1 : 0;
+	if (from < r->left_mar)
+		from = r->left_mar;
+	for (to = r->win->w_width, im = ml->image + to; to >= 0; to--)
+		if (*im-- != ' ')
+			break;
+	if (i == r->y2 && r->x2 < to)
+		to = r->x2;
+	if (to > r->right_mar)
+		to = r->right_mar;
+	*fromp = from;
+	return to;
+}
+
+/*
+ * The text of line i of the region, which is ml, with what glues it
+ * to the next line. Returns its length, the text goes to pt unless
+ * that is 0.
+ */
+static int rem_line(struct region *r, struct mline *ml, int i, char *pt)
 {
-	int i, j, from, to, ry, c;
+	Window *p = r->win;
+	int j, from, to, c;
 	int l = 0;
 	uint32_t *im;
-	struct mline *ml;
 	int cf, cfx, font;
 	uint32_t *fo, *fox;
 
+	to = rem_cols(r, ml, i, &from);
+	j = from;
+	if (dw_right(ml, j, p->w_encoding))
+		j--;
+	im = ml->image + j;
+	fo = ml->font + j;
+	fox = ml->fontx + j;
+	font = ASCII;
+	for (; j <= to; j++) {
+		c = (unsigned char)*im++;
+		cf = (unsigned char)*fo++;
+		cfx = (unsigned char)*fox++;
+		if (p->w_encoding == UTF8) {
+			c |= cf << 8 | cfx << 16;
+			if (c == UCS_HIDDEN)
+				continue;
+			c = ToUtf8_comb(pt, c);
+			l += c;
+			if (pt)
+				pt += c;
+			continue;
+		}
+		if (is_dw_font(cf)) {
+			c = c << 8 | (unsigned char)*im++;
+			fo++;
+			j++;
+		}
+		if (pastefont) {
+			c = EncodeChar(pt, c | cf << 16, p->w_encoding, &font);
+			l += c;
+			if (pt)
+				pt += c;
+			continue;
+		}
+		if (pt)
+			*pt++ = c;
+		l++;
+	}
+	if (pastefont && font != ASCII) {
+		if (pt) {
+			strncpy(pt, "\033(B", 4);
+			pt += 3;
+		}
+		l += 3;
+	}
+	if (i != r->y2 && (to != p->w_width - 1 || ml->image[to + 1] == ' ')) {
+		/*
+		 * this code defines, what glues lines together
+		 */
+		switch (r->nonl) {
+		case 0:	/* lines separated by newlines */
+			if (pt)
+				*pt++ = '\r';
+			l++;
+			if (join_with_cr) {
+				if (pt)
+					*pt++ = '\n';
+				l++;
+			}
+			break;
+		case 1:	/* nothing to separate lines */
+			break;
+		case 2:	/* lines separated by blanks */
+			if (pt)
+				*pt++ = ' ';
+			l++;
+			break;
+		case 3:	/* seperate by comma, for csh junkies */
+			if (pt)
+				*pt++ = ',';
+			l++;
+			break;
+		}
+	}
+	return l;
+}
+
+static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend)
+{
+	int i, from, to, ry, n;
+	int l = 0;
+	struct mline *ml;
+	struct region r;
+
 	markdata->second = 0;
 	if (y2 < y1 || ((y2 == y1) && (x2 < x1))) {
 		i = y2;
@@ -255,6 +384,14 @@ static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend
 		x2 = x1;
 		x1 = i;
 	}
+	r.win = fore;
+	r.x1 = x1;
+	r.y1 = y1;
+	r.x2 = x2;
+	r.y2 = y2;
+	r.left_mar = markdata->left_mar;
+	r.right_mar = markdata->right_mar;
+	r.nonl = markdata->nonl;
 	ry = y1 - markdata->hist_offset;
 
 	i = y1;
@@ -266,93 +403,15 @@ static int rem(int x1, int y1, int x2, int y2, int redisplay, char *pt, int yend
 		if (redisplay != 2 && pt == 0 && ry > yend)
 			break;
 		ml = WIN(i);
-		from = (i == y1) ? x1 : 0;
-		if (from < markdata->left_mar)
-			from = markdata->left_mar;
-		for (to = fore->w_width, im = ml->image + to; to >= 0; to--)
-			if (*im-- != ' ')
-				break;
-		if (i == y2 && x2 < to)
-			to = x2;
-		if (to > markdata->right_mar)
-			to = markdata->right_mar;
+		to = rem_cols(&r, ml, i, &from);
 		if (redisplay == 1 && from <= to && ry >= 0 && ry <= yend)
 			MarkRedisplayLine(ry, from, to, 0);
 		if (redisplay != 2 && pt == 0)	/* don't count/copy */
 			continue;
-		j = from;
-		if (dw_right(ml, j, fore->w_encoding))
-			j--;
-		im = ml->image + j;
-		fo = ml->font + j;
-		fox = ml->fontx + j;
-		font = ASCII;
-		for (; j <= to; j++) {
-			c = (unsigned char)*im++;
-			cf = (unsigned char)*fo++;
-			cfx = (unsigned char)*fox++;
-			if (fore->w_encoding == UTF8) {
-				c |= cf << 8 | cfx << 16;
-				if (c == UCS_HIDDEN)
-					continue;
-				c = ToUtf8_comb(pt, c);
-				l += c;
-				if (pt)
-					pt += c;
-				continue;
-			}
-			if (is_dw_font(cf)) {
-				c = c << 8 | (unsigned char)*im++;
-				fo++;
-				j++;
-			}
-			if (pastefont) {
-				c = EncodeChar(pt, c | cf << 16, fore->w_encoding, &font);
-				l += c;
-				if (pt)
-					pt += c;
-				continue;
-			}
-			if (pt)
-				*pt++ = c;
-			l++;
-		}
-		if (pastefont && font != ASCII) {
-			if (pt) {
-				strncpy(pt, "\033(B", 4);
-				pt += 3;
-			}
-			l += 3;
-		}
-		if (i != y2 && (to != fore->w_width - 1 || ml->image[to + 1] == ' ')) {
-			/*
-			 * this code defines, what glues lines together
-			 */
-			switch (markdata->nonl) {
-			case 0:	/* lines separated by newlines */
-				if (pt)
-					*pt++ = '\r';
-				l++;
-				if (join_with_cr) {
-					if (pt)
-						*pt++ = '\n';
-					l++;
-				}
-				break;
-			case 1:	/* nothing to separate lines */
-				break;
-			case 2:	/* lines separated by blanks */
-				if (pt)
-					*pt++ = ' ';
-				l++;
-				break;
-			case 3:	/* seperate by comma, for csh junkies */
-				if (pt)
-					*pt++ = ',';
-				l++;
-				break;
-			}
-		}
+		n = rem_line(&r, ml, i, pt);
+		l += n;
+		if (pt)
+			pt += n;
 	}
 	return l;
 }
@@ -430,6 +489,7 @@ void MarkRoutine()
 	markdata->rep_cnt = 0;
 	markdata->append_mode = 0;
 	markdata->write_buffer = 0;
+	markdata->export_region = 0;
 	markdata->nonl = 0;
 	markdata->left_mar = 0;
 	markdata->right_mar = fore->w_width - 1;
@@ -562,7 +622,7 @@ static void MarkProcess(char **inbufp, size_t *inlenp)
 			revto(markdata->cx, markdata->cy);
 			break;
 		case '\014':	/* CTRL-L Redisplay */
-			Redisplay(0);
+			Redisplay(-1);
 			LGotoPos(flayer, cx, W2D(cy));
 			break;
 		case 0202:	/* M-C-b */
@@ -847,6 +907,10 @@ static void MarkProcess(char **inbufp, size_t *inlenp)
 			if (od == '>')
 				markdata->write_buffer = 1;
 			/* FALLTHROUGH */
+		case '!':
+			if (od == '!')
+				markdata->export_region = 1;
+			/* FALLTHROUGH */
 		case ' ':
 		case '\r':
 			if (!markdata->second) {
@@ -856,6 +920,20 @@ static void MarkProcess(char **inbufp, size_t *inlenp)
 				revto(cx, cy);
 				LMsg(0, "First mark set - Column %d Line %d", cx + 1, W2D(cy) + 1);
 				break;
+			} else if (markdata->export_region) {
+				struct export *e;
+
+				if (!(e = ExportNew(markdata->x1, markdata->y1, cx, cy))) {
+					LMsg(0, "%s", strnomem);
+					break;
+				}
+				markdata->second = 0;
+				LAY_CALL_UP(LRefreshAll(flayer, 0));
+				ExitOverlayPage();
+				WindowChanged(fore, WINESC_COPY_MODE);
+				Input("Write region to (file, |command or \"register): ", MAXSTR - 1, INP_COOKED, ExportFin, (char *)e, 0);
+				in_mark = 0;
+				break;
 			} else {
 				int append_mode = markdata->append_mode;
 				int write_buffer = markdata->write_buffer;
@@ -1166,6 +1244,8 @@ static void MarkRedisplayLine(int y, int xs, int xe, int isblank)
 			LCDisplayLineWrap(flayer, ml, y, xs, xe, isblank);
 		else
 			LCDisplayLine(flayer, ml, y, xs, xe, isblank);
+		if (search_hl && markdata->isdir && *markdata->isstr)
+			MarkShowMatches(ml, y, wy, xs, xe);
 		return;
 	}
 
@@ -1213,6 +1293,40 @@ static void MarkRedisplayLine(int y, int xs, int xe, int isblank)
 		LCDisplayLine(flayer, ml, y, x, xe, isblank);
 }
 
+/* put the matches of the last search on line y over what is shown */
+static void MarkShowMatches(struct mline *ml, int y, int wy, int xs, int xe)
+{
+	int ms[64], me[64], n, x;
+	struct mchar mc = mchar_so;
+
+	n = SearchMatches(markdata, wy, ms, me, 64);
+	for (int i = 0; i < n; i++) {
+		x = ms[i] > xs ? ms[i] : xs;
+		if (dw_right(ml, x, fore->w_encoding))
+			x--;
+		for (; x <= me[i] && x <= xe; x++) {
+			if (pastefont) {
+				mc.font = ml->font[x];
+				mc.fontx = ml->fontx[x];
+			}
+			mc.image = ml->image[x];
+			mc.mbcs = 0;
+			if (dw_left(ml, x, fore->w_encoding))
+				mc.mbcs = ml->image[x + 1];
+			LPutChar(flayer, &mc, x, y);
+			if (mc.mbcs)
+				x++;
+		}
+	}
+}
+
+/* redraw the page, to show the matches of a new search */
+void MarkRedisplayPage(void)
+{
+	for (int y = 0; y < flayer->l_height; y++)
+		MarkRedisplayLine(y, 0, flayer->l_width - 1, 0);
+}
+
 /*
  * scroll the screen contents up/down.
  */
@@ -1259,6 +1373,48 @@ void MakePaster(struct paster *pa, char *buf, size_t len, int bufiscopy)
 	DoProcess(Layer2Window(flayer), &pa->pa_pasteptr, &pa->pa_pastelen, pa);
 }
 
+#define PASTE_RECODE_CHUNK 16384	/* bytes recoded at a time */
+
+/*
+ * Paste buf, which is in encoding fromenc, as toenc. It is recoded a
+ * piece at a time as the paste goes, instead of into a copy of it all.
+ */
+void MakeRecodingPaster(struct paster *pa, char *buf, size_t len, int fromenc, int toenc)
+{
+	FreePaster(pa);
+	pa->pa_recodeptr = buf;
+	pa->pa_recodelen = len;
+	pa->pa_fromenc = fromenc;
+	pa->pa_toenc = toenc;
+	pa->pa_pastelayer = flayer;
+	if (PasteNext(pa))
+		DoProcess(Layer2Window(flayer), &pa->pa_pasteptr, &pa->pa_pastelen, pa);
+	else
+		FreePaster(pa);
+}
+
+/* recode the next piece of a paste, returns false if there is none */
+bool PasteNext(struct paster *pa)
+{
+	size_t n = pa->pa_recodelen < PASTE_RECODE_CHUNK ? pa->pa_recodelen : PASTE_RECODE_CHUNK;
+	bool last = n == pa->pa_recodelen;
+	int decstate = pa->pa_decstate, font = pa->pa_font;
+	int l;
+
+	if (!pa->pa_recodeptr)
+		return false;
+	l = RecodeBufPart((unsigned char *)pa->pa_recodeptr, n, pa->pa_fromenc, pa->pa_toenc, NULL, &decstate, &font, last);
+	free(pa->pa_pastebuf);
+	if (!(pa->pa_pastebuf = malloc(l ? l : 1)))
+		return false;
+	pa->pa_pasteptr = pa->pa_pastebuf;
+	pa->pa_pastelen = RecodeBufPart((unsigned char *)pa->pa_recodeptr, n, pa->pa_fromenc, pa->pa_toenc,
+					(unsigned char *)pa->pa_pastebuf, &pa->pa_decstate, &pa->pa_font, last);
+	pa->pa_recodeptr = last ? NULL : pa->pa_recodeptr + n;
+	pa->pa_recodelen -= n;
+	return true;
+}
+
 void FreePaster(struct paster *pa)
 {
 	if (pa->pa_pastebuf)
@@ -1267,5 +1423,334 @@ void FreePaster(struct paster *pa)
 	pa->pa_pasteptr = 0;
 	pa->pa_pastelen = 0;
 	pa->pa_pastelayer = 0;
+	pa->pa_recodeptr = 0;
+	pa->pa_recodelen = 0;
+	pa->pa_decstate = pa->pa_font = 0;
 	evdeq(&pa->pa_slowev);
 }
+
+/* stop the pastes that read from buf, which is going away */
+void KillPasters(char *buf, size_t len)
+{
+	struct paster *pa;
+
+	for (Window *w = windows; w; w = w->w_next) {
+		pa = &w->w_paster;
+		if ((pa->pa_pasteptr >= buf && pa->pa_pasteptr - buf < (ptrdiff_t)len)
+		    || (pa->pa_recodeptr >= buf && pa->pa_recodeptr - buf < (ptrdiff_t)len))
+			FreePaster(pa);
+	}
+}
+
+/********************************************************************
+ *  Writing a region out
+ *
+ *  A region is written to a file, a command or a register a chunk at
+ *  a time from the event loop, so the windows keep running while a
+ *  large one is written. Its history lines are found again through
+ *  w_histcount as new output pushes them up. The screen lines can
+ *  change in place, so their text is taken when the region is chosen.
+ */
+
+#define EXPORT_CHUNK 65536	/* bytes made at a time */
+
+struct export {
+	struct export *next;
+	struct region r;
+	struct acluser *user;
+	Display *disp;		/* for the messages, may be gone */
+	uint64_t histcount;	/* w_histcount when the region was chosen */
+	int width, height, histheight;
+	int y;			/* next line to make */
+	int yhist;		/* first line of the region not in the history */
+	char *tail;		/* the text of the screen lines */
+	size_t taillen;
+	char *buf;		/* text that is not written yet */
+	size_t off, len, max;
+	int fd;
+	int reg;		/* register, -1 when writing to fd */
+	char *name;
+	size_t total;
+	time_t lastmsg;
+	Event ev;
+	Event wake;		/* keeps select() from waiting for a register */
+};
+
+static struct export *exports;
+
+static void ExportFree(struct export *);
+static void ExportMsg(struct export *, int, const char *, ...);
+static int ExportRoom(struct export *, size_t);
+static const char *ExportFill(struct export *);
+static void ExportDone(struct export *);
+static void ExportRun(Event *, void *);
+
+/* take the region of copy mode between two marks, with its screen lines */
+static struct export *ExportNew(int x1, int y1, int x2, int y2)
+{
+	struct export *e;
+	char *pt;
+	int i;
+
+	if (!(e = calloc(1, sizeof(*e))))
+		return NULL;
+	if (y2 < y1 || (y2 == y1 && x2 < x1)) {
+		i = y2;
+		y2 = y1;
+		y1 = i;
+		i = x2;
+		x2 = x1;
+		x1 = i;
+	}
+	e->r.win = fore;
+	e->r.x1 = x1;
+	e->r.y1 = y1;
+	e->r.x2 = x2;
+	e->r.y2 = y2;
+	e->r.left_mar = markdata->left_mar;
+	e->r.right_mar = markdata->right_mar;
+	e->r.nonl = markdata->nonl;
+	e->user = markdata->md_user;
+	e->disp = display;
+	e->histcount = fore->w_histcount;
+	e->width = fore->w_width;
+	e->height = fore->w_height;
+	e->histheight = fore->w_histheight;
+	e->yhist = y2 < fore->w_histheight ? y2 + 1 : fore->w_histheight;
+	e->y = y1 < e->yhist ? y1 : e->yhist;
+	e->fd = -1;
+	e->reg = -1;
+	for (i = y1 > e->yhist ? y1 : e->yhist; i <= y2; i++)
+		e->taillen += rem_line(&e->r, WIN(i), i, NULL);
+	if (e->taillen) {
+		if (!(e->tail = malloc(e->taillen))) {
+			free(e);
+			return NULL;
+		}
+		pt = e->tail;
+		for (i = y1 > e->yhist ? y1 : e->yhist; i <= y2; i++)
+			pt += rem_line(&e->r, WIN(i), i, pt);
+	}
+	return e;
+}
+
+static void ExportFree(struct export *e)
+{
+	struct export **ep;
+
+	for (ep = &exports; *ep; ep = &(*ep)->next)
+		if (*ep == e) {
+			*ep = e->next;
+			break;
+		}
+	evdeq(&e->ev);
+	evdeq(&e->wake);
+	if (e->fd >= 0)
+		close(e->fd);
+	free(e->tail);
+	free(e->buf);
+	free(e->name);
+	free(e);
+}
+
+/* a message on the display the region was chosen on, if it is still there */
+static void ExportMsg(struct export *e, int err, const char *fmt, ...)
+{
+	Display *olddisplay = display;
+	char buf[MAXSTR];
+	va_list ap;
+
+	for (display = displays; display; display = display->d_next)
+		if (display == e->disp)
+			break;
+	if (display) {
+		va_start(ap, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, ap);
+		va_end(ap);
+		Msg(err, "%s", buf);
+	}
+	display = olddisplay;
+}
+
+static int ExportRoom(struct export *e, size_t n)
+{
+	size_t max = e->max ? e->max : EXPORT_CHUNK;
+	char *b;
+
+	while (max < e->len + n)
+		max *= 2;
+	if (max == e->max)
+		return 0;
+	if (!(b = realloc(e->buf, max)))
+		return -1;
+	e->buf = b;
+	e->max = max;
+	return 0;
+}
+
+/* make the text of the next lines, returns what went wrong if anything */
+static const char *ExportFill(struct export *e)
+{
+	Window *p = e->r.win;
+	struct mline *ml;
+	size_t start = e->len;
+	uint64_t pushed;
+
+	if (p->w_width != e->width || p->w_height != e->height || p->w_histheight != e->histheight)
+		return "window size changed";
+	pushed = p->w_histcount - e->histcount;
+	for (; e->y < e->yhist && e->len - start < EXPORT_CHUNK; e->y++) {
+		if (pushed > (uint64_t)e->y)
+			return "region left the history";
+		ml = &p->w_hlines[(p->w_histidx + e->y - (int)pushed) % p->w_histheight];
+		if (ExportRoom(e, rem_line(&e->r, ml, e->y, NULL)))
+			return strnomem;
+		e->len += rem_line(&e->r, ml, e->y, e->buf + e->len);
+	}
+	if (e->y >= e->yhist && e->tail) {
+		if (ExportRoom(e, e->taillen))
+			return strnomem;
+		memmove(e->buf + e->len, e->tail, e->taillen);
+		e->len += e->taillen;
+		free(e->tail);
+		e->tail = NULL;
+	}
+	if (e->reg < 0)	/* a lone cr ends a line in a file, as in WriteFile() */
+		for (size_t i = start; i < e->len; i++)
+			if (e->buf[i] == '\r' && (i + 1 == e->len || e->buf[i + 1] != '\n'))
+				e->buf[i] = '\n';
+	return NULL;
+}
+
+static void ExportDone(struct export *e)
+{
+	struct plop *pp;
+
+	if (e->reg < 0) {
+		ExportMsg(e, 0, "Wrote %zu bytes to %s", e->total, e->name);
+		ExportFree(e);
+		return;
+	}
+	if (e->reg == '.') {
+		pp = &e->user->u_plop;
+		if (pp->buf)
+			UserFreeCopyBuffer(e->user);
+	} else {
+		pp = plop_tab + e->reg;
+		if (pp->buf)
+			KillPasters(pp->buf, pp->len);
+		free(pp->buf);
+	}
+	pp->buf = e->buf;
+	pp->len = e->len;
+	pp->enc = e->r.win->w_encoding;
+	e->buf = NULL;
+	if (e->reg == '.')
+		ExportMsg(e, 0, "Copied %zu characters into buffer", pp->len);
+	else
+		ExportMsg(e, 0, "Copied %zu characters into register %c", pp->len, e->reg);
+	ExportFree(e);
+}
+
+static void ExportRun(Event *ev, void *data)
+{
+	struct export *e = (struct export *)data;
+	const char *err;
+	ssize_t n;
+	time_t now;
+
+	(void)ev; /* unused */
+
+	if (e->reg < 0 && e->off == e->len)
+		e->off = e->len = 0;
+	if ((e->reg >= 0 || e->len == 0) && (err = ExportFill(e))) {
+		ExportMsg(e, 0, "Stopped writing region: %s", err);
+		ExportFree(e);
+		return;
+	}
+	if (e->y >= e->yhist && !e->tail && (e->reg >= 0 || e->len == 0)) {
+		ExportDone(e);
+		return;
+	}
+	if (e->reg >= 0) {
+		SetTimeout(&e->wake, 0);
+		evenq(&e->wake);
+	} else {
+		if ((n = write(e->fd, e->buf + e->off, e->len - e->off)) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+			ExportMsg(e, errno, "%s", e->name);
+			ExportFree(e);
+			return;
+		}
+		e->off += n;
+		e->total += n;
+	}
+	if ((now = time(NULL)) != e->lastmsg) {
+		e->lastmsg = now;
+		ExportMsg(e, 0, "Writing region: %d%%", (int)((int64_t)(e->y - e->r.y1) * 100 / (e->r.y2 - e->r.y1 + 1)));
+	}
+}
+
+static void ExportFin(char *buf, size_t len, void *data)
+{
+	struct export *e = (struct export *)data;
+	Window *p;
+
+	for (p = windows; p; p = p->w_next)
+		if (p == e->r.win)
+			break;
+	if (!len || !p) {
+		ExportFree(e);
+		return;
+	}
+	if (*buf == '"') {
+		if (len != 2) {
+			Msg(0, "register: character expected");
+			ExportFree(e);
+			return;
+		}
+		e->reg = (unsigned char)buf[1];
+		e->name = SaveStr(buf);
+		e->ev.type = EV_ALWAYS;
+		e->wake.type = EV_TIMEOUT;
+		e->wake.handler = ExportRun;
+		e->wake.data = (char *)e;
+		SetTimeout(&e->wake, 0);
+		evenq(&e->wake);
+	} else {
+		if (*buf == '|') {
+			for (buf++; *buf == ' '; buf++)
+				;
+			if ((e->fd = printpipe(p, buf)) >= 0)
+				fcntl(e->fd, F_SETFL, O_NONBLOCK);
+		} else if ((e->fd = secopen(buf, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+			Msg(errno, "%s", buf);
+		if (e->fd < 0) {
+			ExportFree(e);
+			return;
+		}
+		e->name = SaveStr(buf);
+		e->ev.type = EV_WRITE;
+		e->ev.fd = e->fd;
+	}
+	e->ev.handler = ExportRun;
+	e->ev.data = (char *)e;
+	evenq(&e->ev);
+	e->next = exports;
+	exports = e;
+}
+
+/* stop writing out the regions of a window that goes away */
+void ExportStop(Window *p)
+{
+	struct export *e, *next;
+
+	for (e = exports; e; e = next) {
+		next = e->next;
+		if (e->r.win == p) {
+			ExportMsg(e, 0, "Stopped writing region: window is gone");
+			ExportFree(e);
+		}
+	}
+}
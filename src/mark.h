@@ -42,11 +42,14 @@ struct markdata {
 	int	rep_cnt;	/* number of repeats */
 	int	append_mode;	/* shall we overwrite or append to copybuffer */
 	int	write_buffer;	/* shall we do a KEY_WRITE_EXCHANGE right away? */
+	int	export_region;	/* write the region out instead of copying it */
 	int	hist_offset;	/* how many lines are on top of the screen */
 	char	isstr[100];	/* string we are searching for */
 	int	isstrl;
 	char	isistr[200];	/* string of chars user has typed */
 	int	isistrl;
+	int	ispos[200];	/* result of the search after each typed char */
+	int	isposl;		/* entries of ispos that are known */
 	int	isdir;		/* current search direction */
 	int	isstartpos;	/* position where isearch was started */
 	int	isstartdir;	/* direction when isearch was started */
@@ -63,9 +66,14 @@ int   GetHistory (void);
 void  MarkRoutine (void);
 void  revto_line (int, int, int);
 void  revto (int, int);
+void  MarkRedisplayPage (void);
 int   InMark (void);
 void  MakePaster (struct paster *, char *, size_t, int);
+void  MakeRecodingPaster (struct paster *, char *, size_t, int, int);
+bool  PasteNext (struct paster *);
 void  FreePaster (struct paster *);
+void  KillPasters (char *, size_t);
+void  ExportStop (Window *);
 
 /* global variables */
 
@@ -58,6 +58,7 @@
 #include "logfile.h"
 #include "mark.h"
 #include "misc.h"
+#include "record.h"
 #include "resize.h"
 #include "search.h"
 #include "socket.h"
@@ -87,6 +88,7 @@ static int ParseWinNum(struct action *, int *);
 static int ParseBase(struct action *, char *, int *, int, char *);
 static int ParseSaveStr(struct action *, char **);
 static int ParseNum(struct action *, int *);
+static long ParseLogAmount(char *, char *, int);
 static int ParseNum1000(struct action *, int *);
 static char **SaveArgs(char **);
 static bool IsNum(char *);
@@ -773,33 +775,37 @@ void DoProcess(Window *window, char **bufp, size_t *lenp, struct paster *pa)
 		evenq(&window->w_paster.pa_slowev);
 		return;
 	}
-	while (flayer && *lenp) {
-		if (!pa && window && window->w_paster.pa_pastelen && flayer == window->w_paster.pa_pastelayer) {
-			WBell(window, visual_bell);
-			*bufp += *lenp;
-			*lenp = 0;
-			display = d;
-			return;
-		}
-		oldlen = *lenp;
-		LayProcess(bufp, lenp);
-		if (pa && !pa->pa_pastelayer)
-			break;	/* flush rest of paste */
-		if (*lenp == oldlen) {
-			if (pa) {
+	do {
+		while (flayer && *lenp) {
+			if (!pa && window && window->w_paster.pa_pastelen && flayer == window->w_paster.pa_pastelayer) {
+				WBell(window, visual_bell);
+				*bufp += *lenp;
+				*lenp = 0;
 				display = d;
 				return;
 			}
-			/* We're full, let's beep */
-			WBell(window, visual_bell);
-			break;
+			oldlen = *lenp;
+			LayProcess(bufp, lenp);
+			if (pa && !pa->pa_pastelayer)
+				break;	/* flush rest of paste */
+			if (*lenp == oldlen) {
+				if (pa) {
+					display = d;
+					return;
+				}
+				/* We're full, let's beep */
+				WBell(window, visual_bell);
+				break;
+			}
 		}
-	}
-	*bufp += *lenp;
-	*lenp = 0;
-	display = d;
-	if (pa && pa->pa_pastelen == 0)
-		FreePaster(pa);
+		*bufp += *lenp;
+		*lenp = 0;
+		display = d;
+		if (!pa || pa->pa_pastelen)
+			return;
+		/* a recoded paste goes on with its next piece */
+	} while (pa->pa_pastelayer && PasteNext(pa));
+	FreePaster(pa);
 }
 
 int FindCommnr(const char *str)
@@ -1056,6 +1062,22 @@ void DoAction(struct action *act, int key)
 		ParseSwitch(act, &b);
 		LogToggle(b);
 		break;
+	case RC_RECORD:
+		b = fore->w_rec ? true : false;
+		ParseSwitch(act, &b);
+		if ((fore->w_rec != NULL) == b) {
+			if (display && !*rc_name)
+				Msg(0, "You are %s recording.", b ? "already" : "not");
+			break;
+		}
+		if (!b) {
+			Msg(0, "Recording \"%s\" closed.", fore->w_rec->name);
+			RecordStop(fore);
+		} else if (RecordStart(fore))
+			Msg(errno, "Error opening recording");
+		else
+			Msg(0, "Recording to \"%s\".", fore->w_rec->name);
+		break;
 	case RC_SUSPEND:
 		Detach(D_STOP);
 		break;
@@ -1357,13 +1379,15 @@ void DoAction(struct action *act, int key)
 				OutputMsg(0, "%s: readreg: too many arguments", rc_name);
 				break;
 			}
-			if ((s = ReadFile(args[1], &n))) {
+			if ((s = ReadFile(args[1], &len))) {
 				struct plop *pp = plop_tab + (int)(unsigned char)ch;
 
-				if (pp->buf)
+				if (pp->buf) {
+					KillPasters(pp->buf, pp->len);
 					free(pp->buf);
+				}
 				pp->buf = s;
-				pp->len = n;
+				pp->len = len;
 				pp->enc = i;
 			}
 		} else
@@ -1405,8 +1429,10 @@ void DoAction(struct action *act, int key)
 		} else {
 			struct plop *plp = plop_tab + (int)(unsigned char)ch;
 
-			if (plp->buf)
+			if (plp->buf) {
+				KillPasters(plp->buf, plp->len);
 				free(plp->buf);
+			}
 			plp->buf = SaveStrn(args[1], argl[1]);
 			plp->len = argl[1];
 			plp->enc = i;
@@ -1803,6 +1829,9 @@ void DoAction(struct action *act, int key)
 	case RC_DISPLAYS:
 		display_displays();
 		break;
+	case RC_GREP:
+		display_grep(*args);
+		break;
 	case RC_WINDOWLIST:
 		if (!*args)
 			display_windows(0, WLIST_NUM, (Window *)0);
@@ -1811,6 +1840,7 @@ void DoAction(struct action *act, int key)
 				if (wliststr)
 					free(wliststr);
 				wliststr = SaveStr(args[1]);
+				WinMsgFormatChanged();
 			}
 			if (msgok)
 				OutputMsg(0, "windowlist string is '%s'", wliststr);
@@ -1907,6 +1937,23 @@ void DoAction(struct action *act, int key)
 			} else if (fore)
 				enc = fore->w_encoding;
 
+			/*
+			 * shortcut:
+			 * if there is only one source and the destination is a window, then
+			 * pass a pointer rather than duplicating the buffer. If it needs
+			 * recoding, that is done a piece at a time as the paste goes.
+			 */
+			if (*s && s[1] == 0 && args[1] == 0) {
+				struct plop *pp = (*s == '.' ? &user->u_plop : &plop_tab[(int)(unsigned char)*s]);
+
+				if (pp->len == 0)
+					OutputMsg(0, "empty buffer");
+				else if (enc == pp->enc)
+					MakePaster(&fore->w_paster, pp->buf, pp->len, 0);
+				else
+					MakeRecodingPaster(&fore->w_paster, pp->buf, pp->len, pp->enc, enc);
+				break;
+			}
 			/*
 			 * measure length of needed buffer
 			 */
@@ -1935,18 +1982,6 @@ void DoAction(struct action *act, int key)
 				OutputMsg(0, "empty buffer");
 				break;
 			}
-			/*
-			 * shortcut:
-			 * if there is only one source and the destination is a window, then
-			 * pass a pointer rather than duplicating the buffer.
-			 */
-			if (s[1] == 0 && args[1] == 0)
-				if (enc == (*s == '.' ? user->u_plop.enc : plop_tab[(int)(unsigned char)*s].enc)) {
-					MakePaster(&fore->w_paster,
-						   *s == '.' ? user->u_plop.buf : plop_tab[(int)(unsigned char)*s].buf,
-						   l, 0);
-					break;
-				}
 			/*
 			 * if no shortcut, we construct a buffer
 			 */
@@ -1988,8 +2023,10 @@ void DoAction(struct action *act, int key)
 					user->u_plop.enc = enc;
 				} else {
 					struct plop *pp = plop_tab + (int)(unsigned char)dch;
-					if (pp->buf)
+					if (pp->buf) {
+						KillPasters(pp->buf, pp->len);
 						free(pp->buf);
+					}
 					pp->buf = dbuf;
 					pp->len = l;
 					pp->enc = enc;
@@ -2054,10 +2091,10 @@ void DoAction(struct action *act, int key)
 			OutputMsg(0, "%s: readbuf: too many arguments", rc_name);
 			break;
 		}
-		if ((s = ReadFile(args[0] ? args[0] : BufferFile, &n))) {
+		if ((s = ReadFile(args[0] ? args[0] : BufferFile, &len))) {
 			if (user->u_plop.buf)
 				UserFreeCopyBuffer(user);
-			user->u_plop.len = n;
+			user->u_plop.len = len;
 			user->u_plop.buf = s;
 			user->u_plop.enc = i;
 			OutputMsg(0, "Read contents of %s into copybuffer",
@@ -2072,6 +2109,16 @@ void DoAction(struct action *act, int key)
 		if (msgok)
 			OutputMsg(0, "Will %signore case in searches", search_ic ? "" : "not ");
 		break;
+	case RC_REGEXSEARCH:
+		(void)ParseSwitch(act, &search_re);
+		if (msgok)
+			OutputMsg(0, "Will search for %s", search_re ? "regular expressions" : "plain strings");
+		break;
+	case RC_HLSEARCH:
+		(void)ParseSwitch(act, &search_hl);
+		if (msgok)
+			OutputMsg(0, "Will %shighlight search matches", search_hl ? "" : "not ");
+		break;
 	case RC_ESCAPE:
 		if (*argl == 0)
 			SetEscape(user, -1, -1);
@@ -2117,12 +2164,55 @@ void DoAction(struct action *act, int key)
 	case RC_LOGFILE:
 		if (*args) {
 			char buf[1024];
+			long amount;
 			if (args[1] && !(strcmp(*args, "flush"))) {
 				log_flush = atoi(args[1]);
 				if (msgok)
 					OutputMsg(0, "log flush timeout set to %ds\n", log_flush);
 				break;
 			}
+			if (args[1] && !strcmp(*args, "maxsize")) {
+				if ((amount = ParseLogAmount(args[1], "bkmg", 1024)) < 0)
+					break;
+				log_maxsize = amount;
+				if (msgok)
+					OutputMsg(0, "logfiles rotated at %ld bytes", amount);
+				break;
+			}
+			if (args[1] && !strcmp(*args, "maxage")) {
+				if ((amount = ParseLogAmount(args[1], "smhd", 0)) < 0 || amount > INT_MAX)
+					break;
+				log_maxage = amount;
+				if (msgok)
+					OutputMsg(0, "logfiles rotated after %lds", amount);
+				break;
+			}
+			if (args[1] && !strcmp(*args, "keep")) {
+				if ((amount = ParseLogAmount(args[1], "", 0)) < 0 || amount > INT_MAX)
+					break;
+				log_keep = amount;
+				if (msgok)
+					OutputMsg(0, "keeping %d old logfiles", log_keep);
+				break;
+			}
+			if (args[1] && !strcmp(*args, "text")) {
+				if (!strcmp(args[1], "off"))
+					log_text = LOG_TEXT_OFF;
+				else if (!strcmp(args[1], "on"))
+					log_text = LOG_TEXT_ON;
+				else if (!strcmp(args[1], "stamp"))
+					log_text = LOG_TEXT_STAMP;
+				else
+					OutputMsg(0, "usage: logfile text on|off|stamp");
+				break;
+			}
+			if (args[1] && !strcmp(*args, "compress")) {
+				if (!strcmp(args[1], "on") || !strcmp(args[1], "off"))
+					log_compress = !strcmp(args[1], "on");
+				else
+					OutputMsg(0, "usage: logfile compress on|off");
+				break;
+			}
 			if (ParseSaveStr(act, &screenlogfile))
 				break;
 			if (fore && fore->w_log)
@@ -2133,6 +2223,17 @@ void DoAction(struct action *act, int key)
 		}
 		OutputMsg(0, "logfile is '%s'", screenlogfile);
 		break;
+	case RC_RECORDFILE:
+		if (*args) {
+			if (ParseSaveStr(act, &screenrecfile))
+				break;
+			if (fore && fore->w_rec && RecordStart(fore))
+				OutputMsg(errno, "Error opening recording");
+			if (!msgok)
+				break;
+		}
+		OutputMsg(0, "recordfile is '%s'", screenrecfile);
+		break;
 	case RC_LOGTSTAMP:
 		if (!*args || !strcmp(*args, "on") || !strcmp(*args, "off")) {
 			if (ParseSwitch(act, &logtstamp_on) == 0 && msgok)
@@ -2375,6 +2476,7 @@ void DoAction(struct action *act, int key)
 				if (hstatusstring)
 					free(hstatusstring);
 				hstatusstring = SaveStr(args[1]);
+				WinMsgFormatChanged();
 				for (display = displays; display; display = display->d_next)
 					RefreshHStatus();
 			}
@@ -2440,6 +2542,7 @@ void DoAction(struct action *act, int key)
 		if (captionstring)
 			free(captionstring);
 		captionstring = SaveStr(args[1]);
+		WinMsgFormatChanged();
 		RedisplayDisplays(0);
 		break;
 	case RC_CONSOLE:
@@ -3439,6 +3542,7 @@ void DoAction(struct action *act, int key)
 		ClearAll();
 		CursorVisibility(-1);
 		D_blocked = 4;
+		InvalidateLineHashes();
 		break;
 	case RC_BLANKERPRG:
 		if (!args[0]) {
@@ -4181,6 +4285,43 @@ int WindowByNoN(char *string)
 	return i;
 }
 
+/*
+ * A number for the logfile rotation settings, optionally followed by
+ * one of the units. units[0] multiplies by one, each following unit by
+ * scale more (by 60, 60 and 24 for time units if scale is 0).
+ */
+static long ParseLogAmount(char *s, char *units, int scale)
+{
+	static const int timescale[] = { 1, 60, 60, 24 };
+	char *end;
+	long n;
+	int i;
+
+	errno = 0;
+	n = strtol(s, &end, 10);
+	if (end == s || n < 0 || errno) {
+		Msg(0, "%s: invalid number '%s'", rc_name, s);
+		return -1;
+	}
+	if (*end) {
+		for (i = 0; units[i] && units[i] != *end; i++)
+			;
+		if (!units[i] || end[1]) {
+			Msg(0, "%s: invalid unit in '%s'", rc_name, s);
+			return -1;
+		}
+		while (i > 0) {
+			if (n > LONG_MAX / (scale ? scale : timescale[i])) {
+				Msg(0, "%s: '%s' is too large", rc_name, s);
+				return -1;
+			}
+			n *= scale ? scale : timescale[i];
+			i--;
+		}
+	}
+	return n;
+}
+
 static int ParseWinNum(struct action *act, int *var)
 {
 	char **args = act->args;
@@ -4440,7 +4581,9 @@ static void LogToggle(bool on)
 	}
 	if (fore->w_log != 0) {
 		Msg(0, "Logfile \"%s\" closed.", fore->w_log->name);
-		logfclose(fore->w_log);
+		WLogScreen(fore);
+		if (fore->w_log)
+			logfclose(fore->w_log);
 		fore->w_log = 0;
 		WindowChanged(fore, WINESC_WFLAGS);
 		return;
@@ -4673,6 +4816,8 @@ static void ShowInfo()
 		sprintf(p += strlen(p), " app");
 	if (wp->w_log)
 		sprintf(p += strlen(p), " log");
+	if (wp->w_rec)
+		sprintf(p += strlen(p), " rec");
 	if (wp->w_monitor != MON_OFF && (ACLBYTE(wp->w_mon_notify, D_user->u_id) & ACLBIT(D_user->u_id))
 	    )
 		sprintf(p += strlen(p), " mon");
@@ -5132,8 +5277,10 @@ static void copy_reg_fn(char *buf, size_t len, void *data)
 		*buf = 0;
 		return;
 	}
-	if (pp->buf)
+	if (pp->buf) {
+		KillPasters(pp->buf, pp->len);
 		free(pp->buf);
+	}
 	pp->buf = 0;
 	pp->len = 0;
 	if (D_user->u_plop.len) {
@@ -51,5 +51,6 @@ extern struct action mmtab[];
 extern struct action umtab[];
 
 extern struct kmap_ext *kmap_exts;
+extern struct plop plop_tab[];
 
 #endif /* SCREEN_PROCESS_H */
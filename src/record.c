@@ -0,0 +1,273 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+/*
+ * Timed session recordings. The output of a window is written with the
+ * time it arrived, through the buffered logfile layer, so recording
+ * costs a memcpy per read and a write() per flush interval. Replay
+ * plays a recording to stdout, i.e. into the window screen -replay is
+ * started in.
+ */
+
+#include "config.h"
+
+#include "record.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "screen.h"
+#include "fileio.h"
+#include "logfile.h"
+#include "winmsg.h"
+
+char *screenrecfile;
+
+static uint64_t RecNow(void);
+static size_t PutNum(char *, uint64_t);
+static int GetNum(FILE *, uint64_t *);
+static void RecordFrame(Window *, char *, size_t, char *, size_t);
+static void ReplayWait(uint64_t);
+static void ReplayOut(char *, size_t);
+
+/* monotonic clock in microseconds */
+static uint64_t RecNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t PutNum(char *p, uint64_t n)
+{
+	size_t l = 0;
+
+	while (n >= 0x80) {
+		p[l++] = (char)(n | 0x80);
+		n >>= 7;
+	}
+	p[l++] = (char)n;
+	return l;
+}
+
+static int GetNum(FILE *fp, uint64_t *np)
+{
+	uint64_t n = 0;
+	int c, shift = 0;
+
+	do {
+		if ((c = getc(fp)) == EOF || shift > 63)
+			return -1;
+		n |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	*np = n;
+	return 0;
+}
+
+/* append a frame, dropping the recording if the file cannot take it */
+static void RecordFrame(Window *win, char *head, size_t headlen, char *buf, size_t len)
+{
+	if (logfwrite(win->w_rec, head, headlen) < 1 || (len && logfwrite(win->w_rec, buf, len) < 1)) {
+		WMsg(win, errno, "Error writing recording");
+		RecordStop(win);
+		return;
+	}
+	if (!log_flush)
+		logfflush(win->w_rec);
+}
+
+/*
+ * Open the recording file of the window and write the start frame.
+ *
+ * returns 0 on success, -1 with errno set on failure; EBUSY if another
+ * window or a log already writes to the file, as their output would end
+ * up between the frames.
+ */
+int RecordStart(Window *win)
+{
+	char buf[1024], head[32];
+	size_t l;
+
+	strncpy(buf, MakeWinMsg(screenrecfile, win, '%'), sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	RecordStop(win);
+	if (islogfile(buf)) {
+		errno = EBUSY;
+		return -1;
+	}
+	if ((win->w_rec = logfopen(buf, secfopen(buf, "a"))) == NULL)
+		return -1;
+	LogFlushStart();
+	head[0] = 'S';
+	memmove(head + 1, REC_MAGIC, 5);
+	head[6] = REC_VERSION;
+	l = 7;
+	l += PutNum(head + l, win->w_width);
+	l += PutNum(head + l, win->w_height);
+	win->w_rectime = RecNow();
+	RecordFrame(win, head, l, NULL, 0);
+	return win->w_rec ? 0 : -1;
+}
+
+/* does a window record to the file? Logs must stay out of it. */
+bool RecordIsFile(char *name)
+{
+	for (Window *p = windows; p; p = p->w_next)
+		if (p->w_rec && !strcmp(p->w_rec->name, name))
+			return true;
+	return false;
+}
+
+void RecordStop(Window *win)
+{
+	if (!win->w_rec)
+		return;
+	logfclose(win->w_rec);
+	win->w_rec = NULL;
+}
+
+void RecordOutput(Window *win, char *buf, size_t len)
+{
+	char head[32];
+	uint64_t now = RecNow();
+	size_t l = 1;
+
+	head[0] = 'o';
+	l += PutNum(head + l, now - win->w_rectime);
+	l += PutNum(head + l, len);
+	win->w_rectime = now;
+	RecordFrame(win, head, l, buf, len);
+}
+
+void RecordResize(Window *win, int width, int height)
+{
+	char head[32];
+	uint64_t now = RecNow();
+	size_t l = 1;
+
+	head[0] = 'r';
+	l += PutNum(head + l, now - win->w_rectime);
+	l += PutNum(head + l, width);
+	l += PutNum(head + l, height);
+	win->w_rectime = now;
+	RecordFrame(win, head, l, NULL, 0);
+}
+
+/*
+ * Replay keeps a running target time instead of sleeping each delta, so
+ * the time spent writing does not add up over a long recording.
+ */
+static uint64_t replaystart, replaytarget;
+
+static void ReplayWait(uint64_t dt)
+{
+	struct timespec ts;
+	uint64_t now;
+
+	replaytarget += dt;
+	now = RecNow() - replaystart;
+	if (replaytarget <= now)
+		return;
+	ts.tv_sec = (replaytarget - now) / 1000000;
+	ts.tv_nsec = (replaytarget - now) % 1000000 * 1000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+static void ReplayOut(char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		if ((n = write(1, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			Panic(errno, "replay");
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+/*
+ * Play a recording to stdout. Delays are divided by speed, a speed of
+ * 0 plays it as fast as possible.
+ *
+ * returns the exit status.
+ */
+int Replay(char *name, double speed)
+{
+	FILE *fp;
+	char buf[4096], magic[6];
+	uint64_t dt, w, h, len;
+	int c;
+
+	if ((fp = fopen(name, "r")) == NULL)
+		Panic(errno, "%s", name);
+	replaystart = RecNow();
+	replaytarget = 0;
+	while ((c = getc(fp)) != EOF) {
+		switch (c) {
+		case 'S':
+			if (fread(magic, 6, 1, fp) != 1 || memcmp(magic, REC_MAGIC, 5))
+				Panic(0, "%s: not a recording", name);
+			if (magic[5] != REC_VERSION)
+				Panic(0, "%s: unsupported recording version %d", name, magic[5]);
+			if (GetNum(fp, &w) || GetNum(fp, &h))
+				goto truncated;
+			break;
+		case 'o':
+			if (GetNum(fp, &dt) || GetNum(fp, &len))
+				goto truncated;
+			if (speed > 0)
+				ReplayWait((uint64_t)(dt / speed));
+			while (len) {
+				size_t n = len < sizeof(buf) ? len : sizeof(buf);
+				if (fread(buf, n, 1, fp) != 1)
+					goto truncated;
+				ReplayOut(buf, n);
+				len -= n;
+			}
+			continue;
+		case 'r':
+			if (GetNum(fp, &dt) || GetNum(fp, &w) || GetNum(fp, &h))
+				goto truncated;
+			if (speed > 0)
+				ReplayWait((uint64_t)(dt / speed));
+			break;
+		default:
+			Panic(0, "%s: not a recording", name);
+		}
+		/* ask the terminal for the recorded size */
+		if (w > 0 && h > 0 && w <= 10000 && h <= 10000) {
+			snprintf(buf, sizeof(buf), "\033[8;%d;%dt", (int)h, (int)w);
+			ReplayOut(buf, strlen(buf));
+		}
+	}
+	/* a recording that is still being written may end in a frame */
+ truncated:
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#ifndef SCREEN_RECORD_H
+#define SCREEN_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "window.h"
+
+/*
+ * A recording is a sequence of frames. Every frame starts with a type
+ * byte, numbers are unsigned LEB128, times are microseconds since the
+ * previous frame:
+ *
+ *   'S' "screc" version width height	start of a recording
+ *   'o' dt length bytes...		window output
+ *   'r' dt width height		window resize
+ *
+ * Recording again to the same file appends a new 'S' frame.
+ */
+#define REC_MAGIC	"screc"
+#define REC_VERSION	1
+
+extern char *screenrecfile;
+
+int  RecordStart(Window *);
+void RecordStop(Window *);
+void RecordOutput(Window *, char *, size_t);
+void RecordResize(Window *, int, int);
+bool RecordIsFile(char *);
+int  Replay(char *, double);
+
+#endif /* SCREEN_RECORD_H */
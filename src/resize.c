@@ -39,6 +39,7 @@
 #include "screen.h"
 
 #include "process.h"
+#include "record.h"
 #include "telnet.h"
 
 /* maximum window width */
@@ -613,6 +614,7 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 			}
 			if (BcopyMline(mlf, lf - lx, mlt, lt - lx, lx, wi + 1))
 				goto nomem;
+			touch_mline(mlt);
 
 			/* did we copy the cursor ? */
 			if (fy == p->w_y + p->w_histheight && lf - lx <= p->w_x && lf > p->w_x) {
@@ -667,6 +669,7 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		if (AllocMline(mlt, wi + 1))
 			goto nomem;
 		MakeBlankLine(mlt->image, wi + 1);
+		touch_mline(mlt);
 		if (--ty >= 0)
 			mlt = NEWWIN(ty);
 	}
@@ -750,6 +753,8 @@ int ChangeWindowSize(Window *p, int wi, int he, int hi)
 		glwz.ws_row = he;
 		ioctl(p->w_ptyfd, TIOCSWINSZ, (char *)&glwz);
 	}
+	if (p->w_rec && wi && (p->w_width != wi || p->w_height != he))
+		RecordResize(p, wi, he);
 
 	/* store new size */
 	p->w_width = wi;
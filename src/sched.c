@@ -36,6 +36,7 @@
 #include <sys/time.h>
 
 #include "screen.h"
+#include "winmsg.h"
 
 static Event *evs;
 static Event *tevs;
@@ -109,6 +110,7 @@ void sched()
 	int nsel;
 
 	for (;;) {
+		WinMsgFlush();	/* status redraws deferred by the last round */
 		if (calctimeout)
 			timeoutev = calctimo();
 		if (timeoutev) {
@@ -168,6 +168,7 @@ int af;
 #include "help.h"
 #include "misc.h"
 #include "process.h"
+#include "record.h"
 #include "socket.h"
 #include "termcap.h"
 #include "tty.h"
@@ -249,6 +250,7 @@ int main(int argc, char **argv)
 	VisualBellString = SaveStr("   Wuff,  Wuff!!  ");
 	ActivityString = SaveStr("Activity in window %n");
 	screenlogfile = SaveStr("screenlog.%n");
+	screenrecfile = SaveStr("screenrec.%n");
 	logtstamp_string = SaveStr("-- %n:%t -- time-stamp -- %M/%d/%y %c:%s --\n");
 	hstatusstring = SaveStr("%h");
 	captionstring = SaveStr("%4n %t");
@@ -470,6 +472,25 @@ int main(int argc, char **argv)
 					cmdflag = true;
 					break;
 				case 'r':
+					if (!strcmp(ap + 1, "eplay")) {
+						double speed = 1;
+						char *name, *end;
+
+						if (--argc == 0)
+							exit_with_usage(myname, "Specify recording with -replay", NULL);
+						name = *++argv;
+						if (argc > 1 && *argv[1] != '-') {
+							speed = strtod(*++argv, &end);
+							argc--;
+							if (*end || speed < 0)
+								exit_with_usage(myname, "Bad replay speed %s", *argv);
+						}
+						/* the recording is read with the invoking user's rights */
+						if (setgid(real_gid) || setuid(real_uid))
+							Panic(errno, "setuid");
+						exit(Replay(name, speed));
+					}
+					/* FALLTHROUGH */
 				case 'R':
 				case 'x':
 					if (argc > 1 && *argv[1] != '-' && !SocketMatch) {
@@ -1142,6 +1163,8 @@ static void DoWait()
 				break;
 			}
 		}
+		if (!win)
+			logfreaped(pid);
 	}
 }
 
@@ -30,21 +30,408 @@
 
 #include "search.h"
 
+#include <regex.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
 
+#include "encoding.h"
 #include "mark.h"
 #include "input.h"
 
 #define INPUTLINE (flayer->l_height - 1)
 
 bool search_ic;
+bool search_re;		/* patterns are extended regular expressions */
+bool search_hl;		/* highlight all matches on the page */
+
+/********************************************************************
+ *  Search engine
+ *
+ *  The pattern is turned into the cells it takes up on the screen:
+ *  one per character, a filler after a double width one, and a
+ *  character with combining characters is compared against what
+ *  utf8_combchars() gives for the cell. With ignorecase both sides go
+ *  through utf8_casefold().
+ *
+ *  Lines whose bloom (see CellBloom()) lacks an ASCII character of the
+ *  pattern are skipped whole. History lines get their bloom in
+ *  WAddLineToHist(), the others when they are first searched. Within
+ *  a line, a Horspool skip table over a hash of the folded characters
+ *  jumps up to the pattern length per probe.
+ *
+ *  Regular expressions run over a UTF-8 copy of the line, joined with
+ *  the lines it wraps onto, with a map from bytes back to cells.
+ */
+
+#define SP_MAXLEN 256
+#define SP_MAXCOMB 16		/* characters in a cell, compared at most */
+#define SP_COMB 0x80000000	/* key of a cell with combining characters */
+#define SP_HASH(k) ((uint32_t)(k) * 0x9e3779b1u >> 24)
+
+struct spattern {
+	uint32_t key[SP_MAXLEN];	/* the cells of the pattern, folded */
+	int seq[2 * SP_MAXLEN];		/* count and characters of the SP_COMB keys */
+	unsigned short fskip[256];	/* shifts for searching forward */
+	unsigned short bskip[256];	/* and backward */
+	int len;
+	uint64_t bloom;
+	Window *win;
+	int width;		/* line length */
+	int rows;		/* lines in history and on screen */
+	bool wraponly;		/* only go on to lines that continue this one */
+	bool utf8;
+	bool ic;
+	bool isre;
+	regex_t re;
+};
+
+/* the text of the line last viewed by sp_view() */
+static char *sp_text;
+static int *sp_cell;		/* cell of each byte, counted from the line start */
+static int *sp_byte;		/* first byte of each cell of the line itself */
+static int sp_textlen, sp_textmax;
+
+#define SP_MAXWRAP 64		/* longest run of wrapped lines for a regex */
+
+static int sp_compile(struct spattern *, Window *, char *, int, int, int, bool);
+static void sp_skiptables(struct spattern *);
+static void sp_free(struct spattern *);
+static struct mline *sp_line(struct spattern *, int);
+static uint32_t sp_char(struct spattern *, struct mline *, int);
+static uint32_t sp_fold(struct spattern *, uint32_t);
+static bool sp_celleq(struct spattern *, int, uint32_t);
+static uint64_t sp_bloom(struct spattern *, int);
+static bool sp_matchat(struct spattern *, int, int);
+static int sp_view(struct spattern *, int);
+static int sp_refindrow(struct spattern *, int, int, int, int, int *);
+static int sp_findrow(struct spattern *, int, int, int, int, int *);
+
+/* returns -1 if str is not a valid regular expression */
+static int sp_compile(struct spattern *sp, Window *win, char *str, int len, int width, int rows, bool wraponly)
+{
+	uint32_t ascii[SP_MAXLEN];
+	int i, n = 0, ns = 0, na = 0, base = -1;
+	int c, state = 0;
+
+	sp->win = win;
+	sp->width = width;
+	sp->rows = rows;
+	sp->wraponly = wraponly;
+	sp->utf8 = win->w_encoding == UTF8;
+	sp->ic = search_ic;
+	sp->isre = false;
+	sp->len = 0;
+	if (len > SP_MAXLEN)
+		len = SP_MAXLEN;
+	if (search_re && len > 0) {
+		char buf[SP_MAXLEN + 1];
+
+		memmove(buf, str, len);
+		buf[len] = 0;
+		if (regcomp(&sp->re, buf, REG_EXTENDED | (search_ic ? REG_ICASE : 0)))
+			return -1;
+		sp->isre = true;
+		sp->len = len;
+		return 0;
+	}
+	for (i = 0; i < len && n < SP_MAXLEN; i++) {
+		c = (unsigned char)str[i];
+		if (sp->utf8 && (c = FromUtf8(c, &state)) < 0) {
+			if (c == -2)
+				i--;	/* broken sequence, start over at this byte */
+			continue;	/* an unfinished one at the end is left out */
+		}
+		if (sp->utf8 && base >= 0 && c >= 0x300 && utf8_iscomb(c)) {
+			/* joins the cell before it, as in utf8_handle_comb() */
+			if (ns + 3 > (int)(sizeof(sp->seq) / sizeof(*sp->seq)))
+				break;
+			if (!(sp->key[base] & SP_COMB)) {
+				sp->seq[ns] = 1;
+				sp->seq[ns + 1] = sp->key[base];
+				sp->key[base] = SP_COMB | ns;
+				ns += 2;
+			}
+			sp->seq[sp->key[base] & ~SP_COMB]++;
+			sp->seq[ns++] = sp_fold(sp, c);
+			continue;
+		}
+		base = n;
+		sp->key[n++] = sp_fold(sp, c);
+		if (sp->utf8 && utf8_isdouble(c) && n < SP_MAXLEN)
+			sp->key[n++] = UCS_HIDDEN;
+	}
+	sp->len = n;
+	/*
+	 * The bloom of a line is made from the image plane, which only holds
+	 * the same value as the character for ASCII. KELVIN SIGN and LONG S
+	 * fold to k and s, so those do not count when ignoring case.
+	 */
+	for (i = 0; i < n; i++)
+		if (sp->key[i] < 0x80 && !(sp->ic && sp->utf8 && (sp->key[i] == 'k' || sp->key[i] == 's')))
+			ascii[na++] = sp->key[i];
+	sp->bloom = CellBloom(ascii, na);
+	sp_skiptables(sp);
+	return 0;
+}
+
+/*
+ * The usual Horspool shifts, and the mirrored ones for searching
+ * backward. Cells with combining characters can be any cell value,
+ * they limit every shift.
+ */
+static void sp_skiptables(struct spattern *sp)
+{
+	int m = sp->len, fmax = m, bmax = m, j;
+
+	for (j = 0; j < m; j++) {
+		if (!(sp->key[j] & SP_COMB))
+			continue;
+		if (j < m - 1 && m - 1 - j < fmax)
+			fmax = m - 1 - j;
+		if (j > 0 && j < bmax)
+			bmax = j;
+	}
+	for (j = 0; j < 256; j++) {
+		sp->fskip[j] = fmax;
+		sp->bskip[j] = bmax;
+	}
+	for (j = 0; j < m - 1; j++)
+		if (!(sp->key[j] & SP_COMB) && m - 1 - j < sp->fskip[SP_HASH(sp->key[j])])
+			sp->fskip[SP_HASH(sp->key[j])] = m - 1 - j;
+	for (j = m - 1; j > 0; j--)
+		if (!(sp->key[j] & SP_COMB) && j < sp->bskip[SP_HASH(sp->key[j])])
+			sp->bskip[SP_HASH(sp->key[j])] = j;
+}
+
+static void sp_free(struct spattern *sp)
+{
+	if (sp->isre)
+		regfree(&sp->re);
+	sp->isre = false;
+}
+
+/* like WIN(), without going through fore */
+static struct mline *sp_line(struct spattern *sp, int y)
+{
+	Window *p = sp->win;
+
+	if (y < p->w_histheight)
+		return &p->w_hlines[(p->w_histidx + y) % p->w_histheight];
+	return &p->w_mlines[y - p->w_histheight];
+}
+
+/* the character in a cell, put together as when copying it */
+static uint32_t sp_char(struct spattern *sp, struct mline *ml, int x)
+{
+	if (!sp->utf8)
+		return ml->image[x];
+	return (ml->image[x] & 0xff) | (ml->font[x] & 0xff) << 8 | (ml->fontx[x] & 0xff) << 16;
+}
+
+static uint32_t sp_fold(struct spattern *sp, uint32_t c)
+{
+	if (!sp->ic)
+		return c;
+	if (sp->utf8)
+		return utf8_casefold(c);
+	return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+/* does cell i of the pattern match character c? */
+static bool sp_celleq(struct spattern *sp, int i, uint32_t c)
+{
+	int cp[SP_MAXCOMB], *seq, n;
+
+	if (!(sp->key[i] & SP_COMB))
+		return sp_fold(sp, c) == sp->key[i];
+	if (c < 0xd800 || c >= 0xe000)
+		return false;
+	seq = sp->seq + (sp->key[i] & ~SP_COMB);
+	if ((n = utf8_combchars(c, cp, SP_MAXCOMB)) != *seq)
+		return false;
+	for (int j = 0; j < n; j++)
+		if (sp_fold(sp, cp[j]) != (uint32_t)seq[j + 1])
+			return false;
+	return true;
+}
+
+static uint64_t sp_bloom(struct spattern *sp, int y)
+{
+	struct mline *ml = sp_line(sp, y);
+
+	if (ml->gen && ml->bloomgen == ml->gen)
+		return ml->bloom;
+	ml->bloom = CellBloom(ml->image, sp->width);
+	ml->bloomgen = ml->gen;
+	return ml->bloom;
+}
+
+/* does the pattern match at column x of line y? */
+static bool sp_matchat(struct spattern *sp, int y, int x)
+{
+	struct mline *ml = sp_line(sp, y);
+
+	for (int i = 0; i < sp->len; i++, x++) {
+		if (x == sp->width) {
+			/* the end of the line holds ' ' unless it wraps */
+			if ((sp->wraponly && ml->image[x] == ' ') || ++y >= sp->rows)
+				return false;
+			ml = sp_line(sp, y);
+			x = 0;
+		}
+		if (!sp_celleq(sp, i, sp_char(sp, ml, x)))
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Make the UTF-8 text of line y and the lines it wraps onto. Returns
+ * 1 if line y itself continues the line before it, 0 if not, -1 if
+ * out of memory.
+ */
+static int sp_view(struct spattern *sp, int y)
+{
+	int x, l, n = 0, cells = 0;
+	uint32_t c;
+	struct mline *ml;
+
+	for (int i = 0; i < SP_MAXWRAP && y + i < sp->rows; i++) {
+		ml = sp_line(sp, y + i);
+		for (x = 0; x < sp->width; x++, cells++) {
+			c = sp_char(sp, ml, x);
+			l = c == UCS_HIDDEN ? 0 : ToUtf8_comb(NULL, c);
+			if (n + l + 1 > sp_textmax || sp->width + 1 > sp_textmax) {
+				int need = 2 * (n + l + sp->width + 1);
+				char *t;
+				int *cp, *b;
+
+				if ((t = realloc(sp_text, need)))
+					sp_text = t;
+				if ((cp = realloc(sp_cell, need * sizeof(int))))
+					sp_cell = cp;
+				if ((b = realloc(sp_byte, need * sizeof(int))))
+					sp_byte = b;
+				if (!t || !cp || !b)
+					return -1;
+				sp_textmax = need;
+			}
+			if (i == 0)
+				sp_byte[x] = n;
+			if (l == 0)
+				continue;	/* right half of a double width char */
+			ToUtf8_comb(sp_text + n, c);
+			for (int j = 0; j < l; j++)
+				sp_cell[n + j] = cells;
+			n += l;
+		}
+		if (ml->image[sp->width] == ' ')
+			break;
+	}
+	sp_byte[sp->width] = n;
+	sp_cell[n] = cells;
+	sp_text[n] = 0;
+	sp_textlen = n;
+	return y > 0 && sp_line(sp, y - 1)->image[sp->width] != ' ';
+}
+
+/*
+ * Like sp_findrow() for a regular expression. The match may also go
+ * on to following lines, but only to those this one wraps onto. The
+ * number of cells matched goes to *lenp.
+ */
+static int sp_refindrow(struct spattern *sp, int y, int sx, int ex, int dir, int *lenp)
+{
+	regmatch_t m;
+	int off, x, found = -1;
+	int notbol;
+
+	if ((notbol = sp_view(sp, y)) < 0)
+		return -1;
+	notbol = notbol ? REG_NOTBOL : 0;
+	for (off = sp_byte[sx]; off <= sp_textlen; ) {
+		if (regexec(&sp->re, sp_text + off, 1, &m, off ? REG_NOTBOL : notbol))
+			break;
+		x = sp_cell[off + m.rm_so];
+		if (x > ex)
+			break;
+		found = x;
+		*lenp = sp_cell[off + m.rm_eo] - x;
+		if (dir > 0)
+			break;
+		/* go on after the match, or at the next character if it is empty */
+		if (m.rm_eo > m.rm_so)
+			off += m.rm_eo;
+		else {
+			off += m.rm_so;
+			while (++off < sp_textlen && sp_cell[off] == x)
+				;
+		}
+		if (off >= sp_textlen)
+			break;
+	}
+	return found;
+}
+
+/*
+ * Find a match starting on line y between columns sx and ex (inclusive),
+ * the first one if dir > 0, else the last one. The rest of the match may
+ * go on to the following lines. Returns the column or -1, the number of
+ * cells matched goes to *lenp.
+ */
+static int sp_findrow(struct spattern *sp, int y, int sx, int ex, int dir, int *lenp)
+{
+	struct mline *ml;
+	uint64_t bloom = 0;
+	uint32_t c;
+	int m = sp->len, x, last;
+	bool wraps;
+
+	if (sx < 0)
+		sx = 0;
+	if (ex > sp->width - 1)
+		ex = sp->width - 1;
+	if (m == 0 || sx > ex)
+		return -1;
+	if (sp->isre)
+		return sp_refindrow(sp, y, sx, ex, dir, lenp);
+	*lenp = m;
+	/* the match can reach this many lines further */
+	for (int i = 0; i <= (m + sp->width - 2) / sp->width && y + i < sp->rows; i++)
+		bloom |= sp_bloom(sp, y + i);
+	if (sp->bloom & ~bloom)
+		return -1;
+	ml = sp_line(sp, y);
+	/* matches from columns after last go on to the next line */
+	last = sp->width - m;
+	wraps = y + 1 < sp->rows && !(sp->wraponly && ml->image[sp->width] == ' ');
+	if (dir > 0) {
+		for (x = sx; x <= ex && x <= last; x += sp->fskip[SP_HASH(sp_fold(sp, c))]) {
+			c = sp_char(sp, ml, x + m - 1);
+			if (sp_celleq(sp, m - 1, c) && sp_matchat(sp, y, x))
+				return x;
+		}
+		for (x = last + 1 > sx ? last + 1 : sx; wraps && x <= ex; x++)
+			if (sp_matchat(sp, y, x))
+				return x;
+	} else {
+		for (x = ex; wraps && x > last && x >= sx; x--)
+			if (sp_matchat(sp, y, x))
+				return x;
+		for (x = ex < last ? ex : last; x >= sx; x -= sp->bskip[SP_HASH(sp_fold(sp, c))]) {
+			c = sp_char(sp, ml, x);
+			if (sp_celleq(sp, 0, c) && sp_matchat(sp, y, x))
+				return x;
+		}
+	}
+	return -1;
+}
 
 /********************************************************************
  *  VI style Search
  */
 
-static int matchword(char *, int, int, int);
 static void searchend(char *, size_t, void *);
 static void backsearchend(char *, size_t, void *);
 
@@ -59,15 +446,19 @@ void Search(int dir)
 			backsearchend(0, 0, 0);
 		else
 			LMsg(0, "No previous pattern");
-	} else
+	} else {
 		Input((dir > 0 ? "/" : "?"), sizeof(markdata->isstr) - 1, INP_COOKED,
 		      (dir > 0 ? searchend : backsearchend), NULL, 0);
+		/* take the pattern in the encoding of the window */
+		flayer->l_encoding = flayer->l_next->l_encoding;
+	}
 }
 
 static void searchend(char *buf, size_t len, void *data)
 {
-	int x = 0, sx, ex, y;
+	int x = 0, sx, ex, y, l;
 	struct markdata *markdata;
+	struct spattern sp;
 	Window *p;
 
 	(void)data; /* unused */
@@ -77,13 +468,23 @@ static void searchend(char *buf, size_t len, void *data)
 	markdata->isdir = 1;
 	if (len)
 		strcpy(markdata->isstr, buf);
+	fore = p;
+	if (sp_compile(&sp, p, markdata->isstr, strlen(markdata->isstr), flayer->l_width,
+		       p->w_histheight + flayer->l_height, true)) {
+		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
+		LMsg(0, "Bad regular expression");
+		return;
+	}
 	sx = markdata->cx + 1;
 	ex = flayer->l_width - 1;
-	for (y = markdata->cy; y < p->w_histheight + flayer->l_height; y++, sx = 0) {
-		if ((x = matchword(markdata->isstr, y, sx, ex)) >= 0)
+	for (y = markdata->cy; y < sp.rows; y++, sx = 0) {
+		if ((x = sp_findrow(&sp, y, sx, ex, 1, &l)) >= 0)
 			break;
 	}
-	if (y >= p->w_histheight + flayer->l_height) {
+	sp_free(&sp);
+	if (search_hl)
+		MarkRedisplayPage();
+	if (y >= sp.rows) {
 		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
 		LMsg(0, "Pattern not found");
 	} else
@@ -92,23 +493,33 @@ static void searchend(char *buf, size_t len, void *data)
 
 static void backsearchend(char *buf, size_t len, void *data)
 {
-	int sx, ex, x = -1, y;
+	int ex, x = -1, y, l;
 	struct markdata *markdata;
+	struct spattern sp;
+	Window *p;
 
 	(void)data; /* unused */
 
 	markdata = (struct markdata *)flayer->l_data;
+	p = markdata->md_window;
 	markdata->isdir = -1;
 	if (len)
 		strcpy(markdata->isstr, buf);
+	fore = p;
+	if (sp_compile(&sp, p, markdata->isstr, strlen(markdata->isstr), flayer->l_width,
+		       p->w_histheight + flayer->l_height, true)) {
+		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
+		LMsg(0, "Bad regular expression");
+		return;
+	}
 	ex = markdata->cx - 1;
 	for (y = markdata->cy; y >= 0; y--, ex = flayer->l_width - 1) {
-		sx = 0;
-		while ((sx = matchword(markdata->isstr, y, sx, ex)) >= 0)
-			x = sx++;
-		if (x >= 0)
+		if ((x = sp_findrow(&sp, y, 0, ex, -1, &l)) >= 0)
 			break;
 	}
+	sp_free(&sp);
+	if (search_hl)
+		MarkRedisplayPage();
 	if (y < 0) {
 		LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
 		LMsg(0, "Pattern not found");
@@ -117,53 +528,70 @@ static void backsearchend(char *buf, size_t len, void *data)
 }
 
 /*
- * Search for a string that matches pattern.  The first character of the
- * match must be on line y, between columns sx and ex (inclusive), but
- * the rest of the match can extend beyond column ex and even onto the
- * following line.  Returns the starting column of the first match found,
- * or -1 if there's no match.
+ * The matches of the last search of copy mode md that start on line y,
+ * as first and last column in xs and xe, for highlighting them. The
+ * pattern stays compiled as long as neither it nor the encoding it was
+ * laid out for changes.
  */
-static int matchword(char *pattern, int y, int sx, int ex)
+int SearchMatches(struct markdata *md, int y, int *xs, int *xe, int max)
 {
-	uint32_t *cp, *cpe;
-	unsigned char *pp;
-	int cy;
-
-	fore = ((struct markdata *)flayer->l_data)->md_window;
-
-	for (; sx <= ex; sx++) {
-		cy = y;
-		cp = WIN(cy)->image + sx;
-		cpe = WIN(cy)->image + flayer->l_width;
-		pp = (unsigned char *)pattern;
-		for (;;) {
-			if ((char)*cp != *pp)
-				if (!search_ic || ((*cp ^ *pp) & 0xdf) || (*cp | 0x20) < 'a' || (*cp | 0x20) > 'z')
-					break;
-			cp++;
-			pp++;
-			if (*pp == 0)
-				return sx;
-			if (cp == cpe) {
-				/*
-				 * We have a partial match, but we've hit
-				 * the end of this line.  Does it wrap onto
-				 * the following line?  If not, we're done.
-				 */
-				if (*cp == ' ' || cy >= fore->w_histheight + flayer->l_height - 1)
-					break;
-
-				/*
-				 * This line does wrap, so look on the next
-				 * line for the rest of our match.
-				 */
-				cy++;
-				cp = WIN(cy)->image;
-				cpe = WIN(cy)->image + flayer->l_width;
-			}
-		}
+	static struct spattern sp;
+	static char str[sizeof(md->isstr)];
+	static bool ic, re, bad;
+	static int encoding;
+	Window *p = md->md_window;
+	int x, len, n = 0;
+
+	if (!sp.win || strcmp(str, md->isstr) || ic != search_ic || re != search_re
+	    || encoding != p->w_encoding) {
+		sp_free(&sp);
+		strcpy(str, md->isstr);
+		ic = search_ic;
+		re = search_re;
+		encoding = p->w_encoding;
+		bad = sp_compile(&sp, p, str, strlen(str), p->w_width, 0, true) != 0;
 	}
-	return -1;
+	if (bad)
+		return 0;
+	sp.win = p;
+	sp.width = p->w_width;
+	sp.rows = p->w_histheight + p->w_height;
+	for (x = 0; n < max && (x = sp_findrow(&sp, y, x, sp.width - 1, 1, &len)) >= 0; x += len > 0 ? len : 1) {
+		if (len <= 0)
+			continue;
+		xs[n] = x;
+		xe[n++] = x + len - 1 < sp.width ? x + len - 1 : sp.width - 1;
+	}
+	return n;
+}
+
+/*
+ * Call fn with the first match on each of n lines of window p, starting
+ * at line y, counted from the oldest history line, until it returns
+ * non-zero.
+ *
+ * returns the line to go on with, 0 when the window is done, or -1 if
+ * str is not a valid regular expression.
+ */
+int SearchWindow(Window *p, char *str, int y, int n, int (*fn)(Window *, struct mline *, int, int, int, void *), void *data)
+{
+	struct spattern sp;
+	int x, len;
+
+	if (p->w_type == W_TYPE_GROUP || !p->w_mlines)
+		return 0;
+	if (sp_compile(&sp, p, str, strlen(str), p->w_width, p->w_histheight + p->w_height, true))
+		return -1;
+	for (; y < sp.rows && n-- > 0; y++)
+		if ((x = sp_findrow(&sp, y, 0, sp.width - 1, 1, &len)) >= 0
+		    && fn(p, sp_line(&sp, y), y, x, len, data)) {
+			y = sp.rows;
+			break;
+		}
+	if (y >= sp.rows)
+		y = 0;
+	sp_free(&sp);
+	return y;
 }
 
 /********************************************************************
@@ -176,57 +604,57 @@ static char *isprompts[] = {
 };
 
 static int is_redo(struct markdata *);
+static bool is_failing(struct markdata *);
 static void is_process(char *, size_t, void *);
-static int is_bm(char *, int, int, int, int);
+static int is_search(char *, int, int, int, int);
 
-static int is_bm(char *str, int l, int p, int end, int dir)
+/*
+ * Find the pattern in the whole image taken as one string of end
+ * cells: the first match at or after position p if dir > 0, else the
+ * last one at or before it.
+ */
+static int is_search(char *str, int l, int p, int end, int dir)
 {
-	int tab[256];
-	int i, q;
-	unsigned char *s, c;
+	struct spattern sp;
+	Window *win;
 	int w = flayer->l_width;
+	int x, y, len, pos = -1;
 
-	/* *sigh* to make WIN work */
-	fore = ((struct markdata *)flayer->l_next->l_data)->md_window;
-	if (p < 0 || p + l > end)
+	/* revto() works on fore */
+	win = fore = ((struct markdata *)flayer->l_next->l_data)->md_window;
+	if (p < 0 || p + (l > 0) > end)
 		return -1;
 	if (l == 0)
 		return p;
-	if (dir < 0)
-		str += l - 1;
-	for (i = 0; i < 256; i++)
-		tab[i] = l * dir;
-	for (i = 0; i < l - 1; i++, str += dir) {
-		q = *(unsigned char *)str;
-		tab[q] = (l - 1 - i) * dir;
-		if (search_ic && (q | 0x20) >= 'a' && ((q | 0x20) <= 'z'))
-			tab[q ^ 0x20] = (l - 1 - i) * dir;
+	if (sp_compile(&sp, win, str, l, w, end / w, false))
+		return -1;	/* not a complete expression yet */
+	/* a regular expression can match fewer cells than it has bytes */
+	if (!sp.isre && p + sp.len > end) {
+		sp_free(&sp);
+		return -1;
 	}
-	if (dir > 0)
-		p += l - 1;
-	while (p >= 0 && p < end) {
-		q = p;
-		s = (unsigned char *)str;
-		for (i = 0;;) {
-			c = (WIN(q / w))->image[q % w];
-			if (i == 0)
-				p += tab[(int)(unsigned char)c];
-			if (c != *s)
-				if (!search_ic || ((c ^ *s) & 0xdf) || (c | 0x20) < 'a' || (c | 0x20) > 'z')
-					break;
-			q -= dir;
-			s -= dir;
-			if (++i == l)
-				return q + (dir > 0 ? 1 : -l);
-		}
+	if (dir > 0) {
+		for (y = p / w, x = p % w; y < sp.rows; y++, x = 0)
+			if ((x = sp_findrow(&sp, y, x, w - 1, 1, &len)) >= 0) {
+				pos = y * w + x;
+				break;
+			}
+	} else {
+		for (y = p / w, x = p % w; y >= 0; y--, x = w - 1)
+			if ((x = sp_findrow(&sp, y, 0, x, -1, &len)) >= 0) {
+				pos = y * w + x;
+				break;
+			}
 	}
-	return -1;
+	sp_free(&sp);
+	return pos;
 }
 
 static void is_process(char *p, size_t len, void *data)
 {				/* i-search */
 	int pos, x, y, dir;
 	struct markdata *markdata;
+	bool typed = false;	/* *p went to isistr */
 
 	(void)data; /* unused */
 
@@ -267,19 +695,27 @@ static void is_process(char *p, size_t len, void *data)
 		}
 		markdata->isdir = dir;
 		markdata->isistr[markdata->isistrl++] = *p;
+		typed = true;
 		break;
 	default:
-		if (*p < ' ' || markdata->isistrl >= (int)sizeof(markdata->isistr)
+		if ((unsigned char)*p < ' ' || markdata->isistrl >= (int)sizeof(markdata->isistr)
 		    || markdata->isstrl >= (int)sizeof(markdata->isstr) - 1)
 			return;
 		markdata->isstr[markdata->isstrl++] = *p;
 		markdata->isistr[markdata->isistrl++] = *p;
 		markdata->isstr[markdata->isstrl] = 0;
+		typed = true;
 	}
-	if (*p && *p != '\b')
+	if (typed && is_failing(markdata))
+		pos = -1;
+	else if (*p && *p != '\b')
 		pos =
-		    is_bm(markdata->isstr, markdata->isstrl, pos,
+		    is_search(markdata->isstr, markdata->isstrl, pos,
 			  flayer->l_width * (markdata->md_window->w_histheight + flayer->l_height), markdata->isdir);
+	if (typed && markdata->isposl == markdata->isistrl - 1)
+		markdata->ispos[markdata->isposl++] = pos;
+	if (search_hl && *p)
+		LAY_CALL_UP(MarkRedisplayPage());
 	if (pos >= 0) {
 		x = pos % flayer->l_width;
 		y = pos / flayer->l_width;
@@ -300,6 +736,31 @@ static void is_process(char *p, size_t len, void *data)
 	}
 }
 
+/*
+ * The last typed char made the text longer, and the text before it
+ * was not found from the same place. Then the longer text is not
+ * found either. Not so for regular expressions, and a combining
+ * character changes the cell before it.
+ */
+static bool is_failing(struct markdata *markdata)
+{
+	int i = markdata->isistrl - 1;
+	char c = markdata->isistr[i];
+
+	if (search_re || i < 1 || markdata->isposl != i || markdata->ispos[i - 1] >= 0)
+		return false;
+	if (c == '\022' || c == '\023' || (unsigned char)c >= 0x80)
+		return false;
+	c = markdata->isistr[i - 1];
+	return c != '\022' && c != '\023';
+}
+
+/*
+ * Go through the typed chars again after some were taken back. The
+ * positions found when they were typed are used as far as they are
+ * known, so only the chars that came with a repeated search need to
+ * be searched for.
+ */
 static int is_redo(struct markdata *markdata)
 {
 	int i, pos, npos, dir;
@@ -308,6 +769,8 @@ static int is_redo(struct markdata *markdata)
 	npos = pos = markdata->isstartpos;
 	dir = markdata->isstartdir;
 	markdata->isstrl = 0;
+	if (markdata->isposl > markdata->isistrl)
+		markdata->isposl = markdata->isistrl;
 	for (i = 0; i < markdata->isistrl; i++) {
 		c = markdata->isistr[i];
 		if (c == '\022')	/* ^R */
@@ -316,13 +779,16 @@ static int is_redo(struct markdata *markdata)
 			pos += (dir = 1);
 		else
 			markdata->isstr[markdata->isstrl++] = c;
-		if (pos >= 0) {
+		if (i < markdata->isposl)
+			npos = markdata->ispos[i];
+		else if (pos >= 0)
 			npos =
-			    is_bm(markdata->isstr, markdata->isstrl, pos,
+			    is_search(markdata->isstr, markdata->isstrl, pos,
 				  flayer->l_width * (markdata->md_window->w_histheight + flayer->l_height), dir);
-			if (npos >= 0)
-				pos = npos;
-		}
+		if (i == markdata->isposl)
+			markdata->ispos[markdata->isposl++] = npos;
+		if (pos >= 0 && npos >= 0)
+			pos = npos;
 	}
 	markdata->isstr[markdata->isstrl] = 0;
 	markdata->isdir = dir;
@@ -336,10 +802,11 @@ void ISearch(int dir)
 	markdata = (struct markdata *)flayer->l_data;
 	markdata->isdir = markdata->isstartdir = dir;
 	markdata->isstartpos = markdata->cx + markdata->cy * flayer->l_width;
-	markdata->isistrl = markdata->isstrl = 0;
+	markdata->isistrl = markdata->isstrl = markdata->isposl = 0;
 	if (W2D(markdata->cy) == INPUTLINE)
 		revto_line(markdata->cx, markdata->cy, INPUTLINE > 0 ? INPUTLINE - 1 : 1);
 	Input(isprompts[dir + 1], sizeof(markdata->isstr) - 1, INP_RAW, is_process, NULL, 0);
+	flayer->l_encoding = flayer->l_next->l_encoding;
 	LGotoPos(flayer, markdata->cx, W2D(markdata->cy));
 	flayer->l_x = markdata->cx;
 	flayer->l_y = W2D(markdata->cy);
@@ -3,11 +3,17 @@
 
 #include <stdbool.h>
 
+#include "mark.h"
+
 void  Search (int);
 void  ISearch (int);
+int   SearchMatches (struct markdata *, int, int *, int *, int);
+int   SearchWindow (Window *, char *, int, int, int (*)(Window *, struct mline *, int, int, int, void *), void *);
 
 /* global variables */
 
 extern bool search_ic;
+extern bool search_re;
+extern bool search_hl;
 
 #endif /* SCREEN_SEARCH_H */
@@ -52,6 +52,7 @@ static int findseq_ge(char *, int, unsigned char **);
 static void setseqoff(unsigned char *, int, int);
 static int addmapseq(char *, int, int);
 static int remmapseq(char *, int);
+static uint32_t TermcapSignature(void);
 
 char Termcap[TERMCAP_BUFSIZE + 8];	/* new termcap +8:"TERMCAP=" */
 static int Termcaplen;
@@ -82,6 +83,26 @@ char *gettermcapstring(char *s)
 	return 0;
 }
 
+/*
+ * Hash the capabilities of the current display, so that displays
+ * driven by identical terminal descriptions can be recognized cheaply.
+ */
+static uint32_t TermcapSignature(void)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	char *s;
+
+	for (int i = 0; i < T_N; i++) {
+		if (term[i].type == T_STR) {
+			for (s = D_tcs[i].str; s && *s; s++)
+				h = (h ^ (unsigned char)*s) * 16777619u;
+			h = (h ^ (D_tcs[i].str ? 0xff : 0xfe)) * 16777619u;
+		} else
+			h = (h ^ (uint32_t)D_tcs[i].num) * 16777619u;
+	}
+	return h;
+}
+
 /*
  * Compile the terminal capabilities for a display.
  * Input: tgetent(, D_termname) extra_incap, extra_outcap.
@@ -390,6 +411,7 @@ int InitTermcap(int width, int height)
 	D_seql = 0;
 	D_seqh = 0;
 
+	D_tcsig = TermcapSignature();
 	D_tcinited = 1;
 	MakeTermcap(0);
 	/* Make sure libterm uses external term properties for our tputs() calls.  */
@@ -0,0 +1,115 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../screen.h"
+#include "../display.h"
+#include "../encoding.h"
+#include "../fileio.h"
+#include "../misc.h"
+#include "../process.h"
+#include "../termcap.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(WriteFile, void, (struct acluser *, char *, int));
+
+/* what fileio.o uses of the rest of screen */
+char *BufferFile, *RcFileName, *SocketName, *hardcopydir, *home;
+char *extra_incap, *extra_outcap;
+char SocketPath[MAXPATHLEN + 2 * MAXSTR];
+char strnomem[] = "Out of memory.";
+bool hardcopy_append;
+struct acluser *users, *EffectiveAclUser;
+Display *display, *displays;
+Layer *flayer;
+Window *fore;
+uid_t eff_uid, real_uid;
+gid_t eff_gid, real_gid;
+
+static int userstat;
+
+void AddStr(char *s) { (void)s; }
+void DisplaySleep1000(int n, int eat) { (void)n; (void)eat; }
+void DoCommand(char **argv, int *argl) { (void)argv; (void)argl; }
+int EncodeChar(char *bp, int c, int encoding, int *fontp) { (void)encoding; (void)fontp; *bp = c; return 1; }
+void Flush(int progress) { (void)progress; }
+void InvalidateLineHashes(void) { }
+char *MakeTermcap(bool aflag) { (void)aflag; return ""; }
+void Msg(int err, const char *fmt, ...) { (void)err; (void)fmt; }
+void Panic(int err, const char *fmt, ...) { (void)err; (void)fmt; abort(); }
+int Parse(char *buf, int bufl, char **args, int *argl) { (void)buf; (void)bufl; (void)args; (void)argl; return 0; }
+char *SaveStr(const char *s) { return strdup(s); }
+int UserContext(void) { return 1; }
+void UserReturn(int val) { userstat = val; }
+int UserStatus(void) { return userstat; }
+void WMsg(Window *p, int err, char *str) { (void)p; (void)err; (void)str; }
+void closeallfiles(int except) { (void)except; }
+void evdeq(Event *ev) { (void)ev; }
+void evenq(Event *ev) { (void)ev; }
+void xsetegid(int gid) { (void)gid; }
+void xseteuid(int uid) { (void)uid; }
+void (*xsignal(int sig, void (*func)(int))) (int) { (void)sig; return func; }
+
+#define W 8
+
+int main(void)
+{
+	uint32_t image[2][W + 1];
+	struct mline ml[2] = { { .image = image[0] }, { .image = image[1] } };
+	Window win;
+	char fn[] = "/tmp/test-fileio.XXXXXX", buf[256];
+	FILE *f;
+	size_t n;
+	int fd;
+
+	for (int x = 0; x <= W; x++)
+		image[0][x] = image[1][x] = ' ';
+	memmove(image[0], (uint32_t[]){'a', 'b'}, 2 * sizeof(uint32_t));
+	memset(&win, 0, sizeof(win));
+	win.w_width = W;
+	win.w_height = 2;
+	win.w_mlines = ml;
+	fore = &win;
+
+	ASSERT((fd = mkstemp(fn)) >= 0);
+	close(fd);
+
+	/* a screen-only copy is complete when WriteFile() returns */
+	WriteFile(NULL, fn, DUMP_HARDCOPY);
+	ASSERT((f = fopen(fn, "r")) != NULL);
+	n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	ASSERT(n == 4 && !memcmp(buf, "ab\n\n", 4));
+
+	/* and an appended one goes behind a separator line */
+	hardcopy_append = true;
+	WriteFile(NULL, fn, DUMP_HARDCOPY);
+	ASSERT((f = fopen(fn, "r")) != NULL);
+	n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	ASSERT(n == 4 + W + 1 + 4 && !memcmp(buf, "ab\n\n>======<\nab\n\n", n));
+
+	unlink(fn);
+	return 0;
+}
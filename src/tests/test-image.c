@@ -0,0 +1,105 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+#include "../image.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(FindNotEq32, int, (const uint32_t *, uint32_t, int));
+SIGNATURE_CHECK(FindNotEq32Rev, int, (const uint32_t *, uint32_t, int));
+SIGNATURE_CHECK(CellBloom, uint64_t, (const uint32_t *, int));
+SIGNATURE_CHECK(FindDiff32, int, (const uint32_t *, const uint32_t *, int));
+SIGNATURE_CHECK(MlineDiff, int, (const struct mline *, const struct mline *, int, int));
+
+#define W 37	/* not a multiple of any vector width */
+
+int main(void)
+{
+	uint32_t a[W], b[W], z[W];
+
+	for (int i = 0; i < W; i++)
+		a[i] = b[i] = ' ', z[i] = 0;
+
+	/* every position is found, in vector body and tail alike */
+	{
+		ASSERT(FindNotEq32(a, ' ', W) == W);
+		ASSERT(FindNotEq32Rev(a, ' ', W) == -1);
+		ASSERT(FindDiff32(a, b, W) == W);
+		ASSERT(FindNotEq32(a, ' ', 0) == 0);
+		ASSERT(FindNotEq32Rev(a, ' ', 0) == -1);
+
+		for (int i = 0; i < W; i++) {
+			b[i] = 'x';
+			ASSERT(FindNotEq32(b, ' ', W) == i);
+			ASSERT(FindNotEq32Rev(b, ' ', W) == i);
+			ASSERT(FindDiff32(a, b, W) == i);
+			ASSERT(FindDiff32(b, a, W) == i);
+			ASSERT(FindNotEq32(b, ' ', i) == i);
+			ASSERT(FindNotEq32Rev(b, ' ', i) == -1);
+			b[i] = ' ';
+		}
+	}
+
+	/* first and last of several differences */
+	{
+		b[3] = b[20] = b[33] = 'y';
+		ASSERT(FindNotEq32(b, ' ', W) == 3);
+		ASSERT(FindNotEq32Rev(b, ' ', W) == 33);
+		ASSERT(FindNotEq32(b + 4, ' ', W - 4) == 16);
+		ASSERT(FindNotEq32Rev(b, ' ', 33) == 20);
+		b[3] = b[20] = b[33] = ' ';
+	}
+
+	/* the bloom of a text is a subset of that of a line holding it */
+	{
+		uint32_t line[] = { 'G', 'r', 'e', 'p', ' ', 'f', 'o', 'r', ' ', 0x20ac };
+		uint32_t word[] = { 'f', 'o', 'R' }, euro[] = { 0x20ac }, g[] = { 'g' }, q[] = { 'q' };
+		uint64_t lb = CellBloom(line, 10);
+
+		ASSERT(CellBloom(a, W) == 0);
+		ASSERT((CellBloom(word, 3) & ~lb) == 0);
+		ASSERT((CellBloom(euro, 1) & ~lb) == 0);
+		ASSERT(CellBloom(line, 1) == CellBloom(g, 1));
+		ASSERT(CellBloom(q, 1) != 0);
+	}
+
+	/* line difference looks at every plane and honours the range */
+	{
+		uint32_t c[W];
+		struct mline m1 = { a, z, z, z, z, z, 0, 0, 0, 0, 0, 0 };
+		struct mline m2 = { b, z, z, z, z, z, 0, 0, 0, 0, 0, 0 };
+
+		for (int i = 0; i < W; i++)
+			c[i] = 0;
+		ASSERT(MlineDiff(&m1, &m2, 0, W - 1) == W);
+		ASSERT(MlineDiff(&m1, &m1, 5, 10) == 11);
+		ASSERT(MlineDiff(&m1, &m2, 7, 6) == 7);
+
+		m2.colorfg = c;
+		c[30] = 1;
+		ASSERT(MlineDiff(&m1, &m2, 0, W - 1) == 30);
+		ASSERT(MlineDiff(&m1, &m2, 0, 29) == 30);
+		ASSERT(MlineDiff(&m1, &m2, 30, 30) == 30);
+		b[12] = 'q';
+		ASSERT(MlineDiff(&m1, &m2, 0, W - 1) == 12);
+		ASSERT(MlineDiff(&m1, &m2, 13, W - 1) == 30);
+	}
+
+	return 0;
+}
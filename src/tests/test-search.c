@@ -0,0 +1,140 @@
+/* This file is part of GNU screen.
+ *
+ * GNU screen is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program (see the file COPYING); if not, see
+ * <http://www.gnu.org/licenses>.
+ *
+ ****************************************************************
+ */
+
+
+#include <string.h>
+
+#include "../screen.h"
+#include "../ansi.h"
+#include "../display.h"
+#include "../encoding.h"
+#include "../fileio.h"
+#include "../input.h"
+#include "../layer.h"
+#include "../mark.h"
+#include "../search.h"
+#include "signature.h"
+#include "macros.h"
+
+SIGNATURE_CHECK(utf8_casefold, int, (int));
+SIGNATURE_CHECK(SearchWindow, int, (Window *, char *, int, int, int (*)(Window *, struct mline *, int, int, int, void *), void *));
+
+/* what search.o and encoding.o use of the rest of screen */
+bool cjkwidth;
+char *screenencodings;
+uint32_t mline_gen;
+uint32_t *null;
+Display *display, *displays;
+Layer *flayer;
+Window *fore;
+
+void ExitOverlayPage(void) { }
+void Input(char *a, size_t b, int c, void (*d)(char *, size_t, void *), char *e, int f) { (void)a; (void)b; (void)c; (void)d; (void)e; (void)f; }
+void LGotoPos(Layer *l, int x, int y) { (void)l; (void)x; (void)y; }
+void LMsg(int err, const char *fmt, ...) { (void)err; (void)fmt; }
+void MarkRedisplayPage(void) { }
+void Resize_obuf(void) { }
+void SetCharsets(Window *p, char *s) { (void)p; (void)s; }
+void inp_setprompt(char *a, char *b) { (void)a; (void)b; }
+void revto(int x, int y) { (void)x; (void)y; }
+void revto_line(int x, int y, int l) { (void)x; (void)y; (void)l; }
+FILE *secfopen(char *name, char *mode) { (void)name; (void)mode; return NULL; }
+
+#define W 20
+
+static uint32_t image[W + 1], font[W + 1], fontx[W + 1];
+
+/* puts the characters of s into the line as a UTF-8 window keeps them */
+static void setline(const int *s)
+{
+	for (int x = 0; x <= W; x++) {
+		int c = *s ? *s++ : ' ';
+
+		image[x] = c & 0xff;
+		font[x] = c >> 8 & 0xff;
+		fontx[x] = c >> 16 & 0xff;
+	}
+}
+
+static int found(Window *p, struct mline *ml, int y, int x, int len, void *data)
+{
+	(void)p; (void)ml; (void)y; (void)len;
+	*(int *)data = x;
+	return 1;
+}
+
+static int find(Window *p, char *str)
+{
+	int x = -1;
+
+	ASSERT(SearchWindow(p, str, 0, 1, found, &x) == 0);
+	return x;
+}
+
+int main(void)
+{
+	/* simple folds, also of letters the hand-picked table used to miss */
+	{
+		static const int folds[][2] = {
+			{'A', 'a'}, {'z', 'z'}, {0x00C9, 0x00E9}, {0x00DF, 0x00DF},
+			{0x0130, 0x0130}, {0x0181, 0x0253}, {0x0186, 0x0254},
+			{0x018F, 0x0259}, {0x01A9, 0x0283}, {0x01B7, 0x0292},
+			{0x01F6, 0x0195}, {0x01F7, 0x01BF}, {0x0220, 0x019E},
+			{0x023A, 0x2C65}, {0x0245, 0x028C}, {0x0370, 0x0371},
+			{0x0376, 0x0377}, {0x037F, 0x03F3}, {0x03C2, 0x03C3},
+			{0x03CF, 0x03D7}, {0x03D0, 0x03B2}, {0x03D1, 0x03B8},
+			{0x03D5, 0x03C6}, {0x03D6, 0x03C0}, {0x03F0, 0x03BA},
+			{0x03F1, 0x03C1}, {0x03F4, 0x03B8}, {0x03F5, 0x03B5},
+			{0x03F9, 0x03F2}, {0x1E9E, 0x00DF}, {0x1F88, 0x1F80},
+			{0x1FBA, 0x1F70}, {0x1FBC, 0x1FB3}, {0x1FFC, 0x1FF3},
+			{0x13F8, 0x13F0}, {0xAB70, 0x13A0}, {0x13A0, 0x13A0},
+			{0x2C7E, 0x023F}, {0x2C7F, 0x0240}, {0x2126, 0x03C9},
+			{0x10400, 0x10428}, {0x1E921, 0x1E943}, {0x1E943, 0x1E943},
+		};
+
+		for (size_t i = 0; i < SIZEOF(folds); i++)
+			ASSERT(utf8_casefold(folds[i][0]) == folds[i][1]);
+	}
+
+	/* ignorecase search of non-ASCII text in a UTF-8 window */
+	{
+		static const int text[] = {'x', 0x0393, 0x03B5, 0x03B9, 0x03AC, 0x0181, 'A', 0x03D0, 0};
+		struct mline ml = { .image = image, .font = font, .fontx = fontx };
+		Window win;
+
+		memset(&win, 0, sizeof(win));
+		win.w_type = W_TYPE_PLAIN;
+		win.w_encoding = UTF8;
+		win.w_width = W;
+		win.w_height = 1;
+		win.w_mlines = &ml;
+		setline(text);
+
+		search_ic = false;
+		ASSERT(find(&win, "\xce\x93\xce\xb5") == 1);		/* Γε */
+		ASSERT(find(&win, "\xce\xb3\xce\xb5") == -1);		/* γε */
+		search_ic = true;
+		ASSERT(find(&win, "\xce\xb3\xce\x95") == 1);		/* γΕ */
+		ASSERT(find(&win, "\xce\x86\xc9\x93") == 4);		/* Άɓ */
+		ASSERT(find(&win, "a\xce\x92") == 6);			/* aΒ */
+		ASSERT(find(&win, "\xce\xb3\xce\x95\xce\xb6") == -1);	/* γΕζ */
+	}
+
+	return 0;
+}
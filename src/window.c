@@ -48,6 +48,7 @@
 #include "misc.h"
 #include "process.h"
 #include "pty.h"
+#include "record.h"
 #include "resize.h"
 #include "telnet.h"
 #include "termcap.h"
@@ -62,6 +63,9 @@ static int WinResize(int, int);
 static void WinRestore(void);
 static int DoAutolf(char *, size_t *, int);
 static void ZombieProcess(char **, size_t *);
+static void MultiInput(Window *, char *, size_t);
+static void InQueueWrite(Window *);
+static void InQueueFlush(Window *);
 static void win_readev_fn(Event *, void *);
 static void win_writeev_fn(Event *, void *);
 static void win_resurrect_zombie_fn(Event *, void *);
@@ -69,6 +73,7 @@ static int muchpending(Window *, Event *);
 static void paste_slowev_fn(Event *, void *);
 static void pseu_readev_fn(Event *, void *);
 static void pseu_writeev_fn(Event *, void *);
+static size_t PseuRoom(struct pseudowin *, size_t);
 static void win_silenceev_fn(Event *, void *);
 static void win_destroyev_fn(Event *, void *);
 
@@ -143,6 +148,9 @@ struct NewWindow nwin_options;
 static int const_IOSIZE = IOSIZE;
 static int const_one = 1;
 
+#define PSEU_INMAX (IOSIZE * 64)	/* most window output a filter may lag */
+static int const_PSEU_INMAX = PSEU_INMAX;
+
 void nwin_compose(struct NewWindow *def, struct NewWindow *new, struct NewWindow *res)
 {
 #define COMPOSE(x) res->x = new->x != nwin_undef.x ? new->x : def->x
@@ -251,7 +259,7 @@ static void WinProcess(char **bufpp, size_t *lenp)
 		/* we send the user input to our pseudowin */
 		ibuf = fore->w_pwin->p_inbuf;
 		ilen = &fore->w_pwin->p_inlen;
-		f = sizeof(fore->w_pwin->p_inbuf) - *ilen;
+		f = fore->w_pwin->p_insize - *ilen;
 	} else {
 		/* we send the user input to the window */
 		ibuf = fore->w_inbuf;
@@ -279,12 +287,117 @@ static void WinProcess(char **bufpp, size_t *lenp)
 		}
 #endif
 		*ilen += l2;
+		if (fore->w_miflag)
+			MultiInput(fore, ibuf + *ilen - l2, l2);
 		*bufpp += l;
 		*lenp -= l;
 		return;
 	}
 }
 
+/*
+ * Input typed into a window with multiinput set goes to all the other
+ * such windows as well. The bytes are kept once, in a chunk shared by
+ * their queues, and every window writes them out when its pty is ready
+ * for them, so that one busy window holds up neither the others nor us.
+ */
+struct inchunk {
+	int refs;
+	size_t len;
+	char buf[];
+};
+
+struct inqueue {
+	struct inqueue *next;
+	struct inchunk *chunk;
+	size_t off;		/* bytes of chunk already written */
+};
+
+#define INQUEUE_MAX (1024 * 1024)	/* how far a window may fall behind */
+
+static void MultiInput(Window *p, char *buf, size_t len)
+{
+	struct inchunk *c = NULL;
+	struct inqueue *q;
+
+	if (len == 0)
+		return;
+	for (Window *win = windows; win; win = win->w_next) {
+		if (win == p || !win->w_miflag || win->w_ptyfd < 0)
+			continue;
+		if (win->w_inqueued + len > INQUEUE_MAX) {
+			if (!win->w_inqueuefull)
+				Msg(0, "multiinput: window %d is not taking input", win->w_number);
+			win->w_inqueuefull = true;
+			continue;
+		}
+		if (!c) {
+			if ((c = malloc(sizeof(struct inchunk) + len)) == NULL)
+				break;
+			c->refs = 0;
+			c->len = len;
+			memmove(c->buf, buf, len);
+		}
+		if ((q = malloc(sizeof(struct inqueue))) == NULL)
+			break;
+		q->next = NULL;
+		q->chunk = c;
+		q->off = 0;
+		c->refs++;
+		if (win->w_inqueuelast)
+			win->w_inqueuelast->next = q;
+		else
+			win->w_inqueue = q;
+		win->w_inqueuelast = q;
+		win->w_inqueued += len;
+		win->w_writeev.condpos = NULL;	/* ready whenever the pty is */
+	}
+	if (c && c->refs == 0)
+		free(c);
+}
+
+static void InQueuePop(Window *p)
+{
+	struct inqueue *q = p->w_inqueue;
+
+	p->w_inqueued -= q->chunk->len - q->off;
+	if (--q->chunk->refs == 0)
+		free(q->chunk);
+	if ((p->w_inqueue = q->next) == NULL) {
+		p->w_inqueuelast = NULL;
+		p->w_inqueuefull = false;
+		p->w_writeev.condpos = (int *)&p->w_inlen;
+	}
+	free(q);
+}
+
+/* write out as much of the queue as the pty takes */
+static void InQueueWrite(Window *p)
+{
+	struct inqueue *q;
+	ssize_t n;
+
+	while ((q = p->w_inqueue)) {
+		n = write(p->w_ptyfd, q->chunk->buf + q->off, q->chunk->len - q->off);
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if (n <= 0) {	/* dead window */
+			InQueueFlush(p);
+			return;
+		}
+		p->w_inqueued -= n;
+		if ((q->off += n) < q->chunk->len)
+			return;
+		InQueuePop(p);
+	}
+}
+
+static void InQueueFlush(Window *p)
+{
+	while (p->w_inqueue)
+		InQueuePop(p);
+}
+
 static void ZombieProcess(char **bufpp, size_t *lenp)
 {
 	size_t l = *lenp;
@@ -358,13 +471,12 @@ static void WinRestore()
 
 /*
  * DoStartLog constructs a path for the "want to be logfile" in buf and
- * attempts logfopen.
+ * attempts logfopen. A file a window records to is refused with EBUSY.
  *
  * returns 0 on success.
  */
 int DoStartLog(Window *window, char *buf, int bufsize)
 {
-	int n;
 	if (!window || !buf)
 		return -1;
 
@@ -373,16 +485,62 @@ int DoStartLog(Window *window, char *buf, int bufsize)
 
 	if (window->w_log != NULL)
 		logfclose(window->w_log);
+	window->w_log = NULL;
 
+	if (RecordIsFile(buf)) {
+		errno = EBUSY;
+		return -2;
+	}
 	if ((window->w_log = logfopen(buf, islogfile(buf) ? NULL : secfopen(buf, "a"))) == NULL)
 		return -2;
-	if (!logflushev.queued) {
-		n = log_flush ? log_flush : (logtstamp_after + 4) / 5;
-		if (n) {
-			SetTimeout(&logflushev, n * 1000);
-			evenq(&logflushev);
-		}
+	LogFlushStart();
+	return 0;
+}
+
+/* make sure the periodic flush of logfiles is running */
+void LogFlushStart(void)
+{
+	int n;
+
+	if (logflushev.queued)
+		return;
+	n = log_flush ? log_flush : (logtstamp_after + 4) / 5;
+	if (n) {
+		SetTimeout(&logflushev, n * 1000);
+		evenq(&logflushev);
 	}
+}
+
+/*
+ * RotateLog starts a new segment of the window's log. The name is made
+ * again first: if it changed, e.g. with a date in it, the window just
+ * moves on to the new file, else the file is rotated in place.
+ *
+ * returns nonzero if the window lost its log.
+ */
+int RotateLog(Window *window)
+{
+	char buf[1024], *oname;
+	Log *l = window->w_log;
+
+	strncpy(buf, MakeWinMsg(screenlogfile, window, '%'), sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+	if (!strcmp(buf, l->name)) {
+		if (logfrotate(l) == 0)
+			return 0;
+		window->w_log = NULL;	/* logfrotate() logfclose()d it */
+		WMsg(window, errno, "Error rotating logfile");
+		return -1;
+	}
+	oname = SaveStr(l->name);
+	if (DoStartLog(window, buf, sizeof(buf))) {
+		WMsg(window, errno, "Error opening logfile");
+		free(oname);
+		return -1;
+	}
+	if (log_compress && oname && !islogfile(oname))
+		logfcompress(oname);
+	free(oname);
 	return 0;
 }
 
@@ -727,6 +885,7 @@ void CloseDevice(Window *window)
 	window->w_tty[0] = 0;
 	evdeq(&window->w_readev);
 	evdeq(&window->w_writeev);
+	InQueueFlush(window);
 #ifdef ENABLE_TELNET
 	evdeq(&window->w_telconnev);
 #endif
@@ -746,8 +905,12 @@ void FreeWindow(Window *window)
 		TtyGrabConsole(-1, false, "free");
 		console_window = 0;
 	}
+	WLogScreen(window);
 	if (window->w_log != NULL)
 		logfclose(window->w_log);
+	RecordStop(window);
+	ExportStop(window);
+	HardcopyStop(window);
 	ChangeWindowSize(window, 0, 0, 0);
 
 	if (window->w_type == W_TYPE_GROUP) {
@@ -805,6 +968,7 @@ void FreeWindow(Window *window)
 	evdeq(&window->w_zombieev);
 	evdeq(&window->w_destroyev);
 	FreePaster(&window->w_paster);
+	InQueueFlush(window);
 	free((char *)window);
 }
 
@@ -1135,10 +1299,12 @@ int winexec(char **av)
 		Msg(0, "You feel dead inside.");
 		return -1;
 	}
-	if (!(pwin = calloc(1, sizeof(struct pseudowin)))) {
+	if (!(pwin = calloc(1, sizeof(struct pseudowin))) || !(pwin->p_inbuf = malloc(IOSIZE))) {
+		free(pwin);
 		Msg(0, "%s", strnomem);
 		return -1;
 	}
+	pwin->p_insize = IOSIZE;
 
 	/* allow ^a:!!./ttytest as a short form for ^a:exec !.. ./ttytest */
 	for (s = *av; *s == ' '; s++) ;
@@ -1196,6 +1362,7 @@ int winexec(char **av)
 	*--t = '\0';
 
 	if ((pwin->p_ptyfd = OpenDevice(av, 0, &type, &t)) < 0) {
+		free(pwin->p_inbuf);
 		free((char *)pwin);
 		return -1;
 	}
@@ -1266,6 +1433,7 @@ void FreePseudowin(Window *w)
 	if (w->w_readev.condneg == (int *)&pwin->p_inlen)
 		w->w_readev.condpos = w->w_readev.condneg = 0;
 	evenq(&w->w_readev);
+	free(pwin->p_inbuf);
 	free((char *)pwin);
 	w->w_pwin = NULL;
 }
@@ -1319,7 +1487,7 @@ static void paste_slowev_fn(Event *event, void *data)
 	p = Layer2Window(flayer);
 	DoProcess(p, &pa->pa_pasteptr, &len, pa);
 	pa->pa_pastelen -= 1 - len;
-	if (pa->pa_pastelen > 0) {
+	if (pa->pa_pastelen > 0 || (pa->pa_pastelayer && PasteNext(pa))) {
 		SetTimeout(&pa->pa_slowev, p->w_slowpaste);
 		evenq(&pa->pa_slowev);
 	}
@@ -1340,6 +1508,7 @@ static int muchpending(Window *p, Event *event)
 		if (D_obufp - D_obuf > D_obufmax + D_blocked_fuzz) {
 			if (D_nonblock == 0) {
 				D_blocked = 1;
+				InvalidateLineHashes();	/* output will be skipped */
 				continue;
 			}
 			event->condpos = &D_obuffree;
@@ -1366,9 +1535,9 @@ static void win_readev_fn(Event *event, void *data)
 
 	wtop = p->w_pwin && W_WTOP(p);
 	if (wtop) {
-		size = IOSIZE - p->w_pwin->p_inlen;
+		size = PseuRoom(p->w_pwin, IOSIZE);
 		if (size <= 0) {
-			event->condpos = &const_IOSIZE;
+			event->condpos = &const_PSEU_INMAX;
 			event->condneg = (int *)&p->w_pwin->p_inlen;
 			return;
 		}
@@ -1416,13 +1585,22 @@ static void win_readev_fn(Event *event, void *data)
 	if (p->w_type == W_TYPE_TELNET)
 		len = TelIn(p, bp, len, buf + sizeof(buf) - (bp + len));
 #endif
+	p->w_readbytes += len;
 	if (len == 0)
 		return;
 	if (zmodem_mode && zmodem_parse(p, bp, len))
 		return;
 	if (wtop) {
-		memmove(p->w_pwin->p_inbuf + p->w_pwin->p_inlen, bp, len);
-		p->w_pwin->p_inlen += len;
+		struct pseudowin *pw = p->w_pwin;
+		ssize_t n = 0;
+
+		/* nothing queued for the filter: hand it the output right away */
+		if (pw->p_inlen == 0 && (n = write(pw->p_ptyfd, bp, len)) < 0)
+			n = 0;
+		if (n < len) {
+			memmove(pw->p_inbuf + pw->p_inlen, bp + n, len - n);
+			pw->p_inlen += len - n;
+		}
 	}
 
 	LayPause(&p->w_layer, 1);
@@ -1452,19 +1630,25 @@ static void win_writeev_fn(Event *event, void *data)
 	if (p->w_inlen) {
 		if ((len = write(event->fd, p->w_inbuf, p->w_inlen)) <= 0)
 			len = p->w_inlen;	/* dead window */
-
-		if (p->w_miflag) { /* don't loop if not needed */
-			for (Window *win = windows; win; win = win->w_next) {
-				if (win != p && win->w_miflag)
-					write(win->w_ptyfd, p->w_inbuf, p->w_inlen);
-			}
-		}
-
 		if ((p->w_inlen -= len))
 			memmove(p->w_inbuf, p->w_inbuf + len, p->w_inlen);
 	}
+	if (p->w_inqueue)
+		InQueueWrite(p);
 	if (p->w_paster.pa_pastelen && !p->w_slowpaste) {
 		struct paster *pa = &p->w_paster;
+		ssize_t n;
+
+		/*
+		 * A paste into the window itself that needs no input processing
+		 * goes to the pty straight from its buffer, as much as it takes.
+		 */
+		if (!p->w_inlen && pa->pa_pastelayer == &p->w_layer && p->w_type == W_TYPE_PTY
+		    && !p->w_autolf && !p->w_miflag && !W_UWP(p)
+		    && (n = write(event->fd, pa->pa_pasteptr, pa->pa_pastelen)) > 0) {
+			pa->pa_pasteptr += n;
+			pa->pa_pastelen -= n;
+		}
 		flayer = pa->pa_pastelayer;
 		if (flayer)
 			DoProcess(p, &pa->pa_pasteptr, &pa->pa_pastelen, pa);
@@ -1536,6 +1720,34 @@ static void pseu_writeev_fn(Event *event, void *data)
 		len = pw->p_inlen;	/* dead pseudo */
 	if ((p->w_pwin->p_inlen -= len))
 		memmove(p->w_pwin->p_inbuf, p->w_pwin->p_inbuf + len, p->w_pwin->p_inlen);
+	else if (pw->p_insize > IOSIZE) {
+		/* the filter caught up, give back what it needed */
+		char *b = realloc(pw->p_inbuf, IOSIZE);
+		if (b) {
+			pw->p_inbuf = b;
+			pw->p_insize = IOSIZE;
+		}
+	}
+}
+
+/*
+ * Make room for up to len more bytes of window output in the filter's
+ * buffer, growing it as long as the filter falls behind. Returns how
+ * much fits.
+ */
+static size_t PseuRoom(struct pseudowin *pw, size_t len)
+{
+	size_t size = pw->p_insize;
+	char *b;
+
+	while (size - pw->p_inlen < len && size < PSEU_INMAX)
+		size *= 2;
+	if (size != pw->p_insize && (b = realloc(pw->p_inbuf, size))) {
+		pw->p_inbuf = b;
+		pw->p_insize = size;
+	}
+	size = pw->p_insize - pw->p_inlen;
+	return size < len ? size : len;
 }
 
 static void win_silenceev_fn(Event *event, void *data)
@@ -1605,6 +1817,7 @@ static int zmodem_parse(Window *p, char *bp, size_t len)
 					D_readev.condpos = D_readev.condneg = 0;
 					while (len-- > 0)
 						AddChar(*bp++);
+					InvalidateLineHashes();
 					Flush(0);
 					Activate(D_fore ? D_fore->w_norefresh : 0);
 					return 1;
@@ -1620,6 +1833,7 @@ static int zmodem_parse(Window *p, char *bp, size_t len)
 		display = p->w_zdisplay;
 		while (len-- > 0)
 			AddChar(*bp++);
+		InvalidateLineHashes();
 		return 1;
 	}
 	return 0;
@@ -1681,6 +1895,7 @@ static void zmodem_found(Window *p, int send, char *bp, size_t len)
 		ClearAll();
 		GotoPos(0, 0);
 		SetRendition(&mchar_blank);
+		InvalidateLineHashes();
 		AddStr("Zmodem active\r\n\r\n");
 		AddStr(send ? "**\030B01" : "**\030B00");
 		while (len-- > 0)
@@ -76,8 +76,9 @@ struct pseudowin {
 	Event	p_writeev;
 	char	p_cmd[MAXSTR];
 	char	p_tty[MAXSTR];
-	char	p_inbuf[IOSIZE];	/* buffered writing to p_ptyfd */
+	char	*p_inbuf;		/* buffered writing to p_ptyfd */
 	size_t	p_inlen;
+	size_t	p_insize;		/* grows while the filter lags */
 };
 
 /* bits for fdpat: */
@@ -131,6 +132,10 @@ struct paster {
 	size_t	 pa_pastelen;		/* bytes left to paste */
 	Layer	*pa_pastelayer;		/* layer to paste into */
 	Event	 pa_slowev;		/* slowpaste event */
+	char	*pa_recodeptr;		/* text still to be recoded into pastebuf */
+	size_t	 pa_recodelen;
+	int	 pa_fromenc, pa_toenc;
+	int	 pa_decstate, pa_font;	/* recoding state between the pieces */
 };
 
 typedef struct Window Window;
@@ -154,6 +159,10 @@ struct Window {
 	size_t	 w_inlen;
 	char	 w_outbuf[IOSIZE];
 	int	 w_outlen;
+	uint64_t w_readbytes;		/* bytes read from the pty */
+	uint64_t w_ratebytes;		/* w_readbytes at w_ratetime */
+	time_t	 w_ratetime;		/* when w_rate was computed */
+	uint64_t w_rate;		/* bytes read per second */
 	bool	 w_aflag;		/* (-a option) */
 	bool	 w_dynamicaka;		/* should we change name */
 	char	*w_title;		/* name of the window */
@@ -212,6 +221,8 @@ struct Window {
 	int	 w_flow;		/* flow flags */
 	Log	 *w_log;	/* log to file */
 	int	 w_logsilence;		/* silence in secs */
+	Log	 *w_rec;		/* timed recording of the output */
+	uint64_t w_rectime;		/* when the last frame was recorded */
 	int	 w_monitor;		/* monitor status */
 	int	 w_silencewait;		/* wait for silencewait secs */
 	int	 w_silence;		/* silence status (Lloyd Zusman) */
@@ -224,6 +235,8 @@ struct Window {
 	int	 w_slowpaste;		/* do careful writes to the window */
 	int	 w_histheight;		/* all histbases are malloced with width * histheight */
 	int	 w_histidx;		/* 0 <= histidx < histheight; where we insert lines */
+	uint64_t w_histcount;		/* lines that went to the history so far */
+	int	 w_hardcopies;		/* hardcopies waiting for history lines */
 	struct	 mline *w_hlines;	/* history buffer */
 	struct	 paster w_paster;	/* paste info */
 	pid_t	 w_pid;			/* process at the other end of ptyfd */
@@ -268,6 +281,10 @@ struct Window {
 	Event w_destroyev;		/* window destroy event */
 	int w_exitstatus;
 	bool w_miflag;
+	struct inqueue *w_inqueue;	/* multiinput from other windows */
+	struct inqueue *w_inqueuelast;
+	size_t	 w_inqueued;		/* bytes in w_inqueue */
+	bool	 w_inqueuefull;		/* input was dropped */
 };
 
 
@@ -321,6 +338,8 @@ int   winexec (char **);
 void  FreePseudowin (Window *);
 void  nwin_compose (struct NewWindow *, struct NewWindow *, struct NewWindow *);
 int   DoStartLog (Window *, char *, int);
+int   RotateLog (Window *);
+void  LogFlushStart (void);
 int   ReleaseAutoWritelock (Display *, Window *);
 int   ObtainAutoWritelock (Display *, Window *);
 void  CloseDevice (Window *);
@@ -72,6 +72,47 @@ WinMsgBuf *g_winmsg;
 #define WinMsgDoEsc(name) winmsg_esc__name(name)(WINMSG_ESC_ARGS)
 #define WinMsgDoEscEx(name, ...) winmsg_esc__name(name)(WINMSG_ESC_ARGS, __VA_ARGS__)
 
+/* number of compiled format strings kept around */
+#define WINMSG_PROGCACHE 64
+
+/* one instruction of a compiled format string */
+typedef struct {
+	int type;		/* escape character, 0 for literal text */
+	WinMsgEsc esc;		/* parsed flags and number of the escape */
+	char *s;		/* escape: its character in the source copy,
+				 * literal: start of the text */
+	int len;		/* literal: length of the text */
+	uint64_t rend;		/* WINESC_REND_START: parsed rendition */
+	bool rendok;		/* WINESC_REND_START: rendition is complete */
+} WinMsgOp;
+
+/* a format string compiled for one escape character */
+typedef struct {
+	char *src;		/* private copy of the format string */
+	int chesc;
+	uint32_t hash;
+	WinMsgOp *ops;
+	int nops;
+	char *lit;		/* literal text, ^X sequences resolved */
+	uint32_t deps[0x200 / 32];	/* escapes used, | 0x100 for long forms */
+	uint64_t btids;		/* backtick ids used, bit id % 64 */
+	int busy;		/* evaluations running, backticks recurse */
+	bool cached;
+} WinMsgProg;
+
+static WinMsgProg *progcache[WINMSG_PROGCACHE];
+
+/* status surfaces whose format string uses an escape, see WindowChanged() */
+#define WINMSG_DEP_CAPTION 1
+#define WINMSG_DEP_HSTATUS 2
+#define WINMSG_DEP_WLIST   4
+
+static uint8_t winmsgdeps[0x200];
+static uint8_t winmsgbtdeps[64];	/* surfaces using backtick id % 64 */
+static bool winmsgdepsok;
+static int winmsgbtid = -1;	/* backtick that changed, or -1 for any */
+static bool winmsgdirty;	/* some surface waits for WinMsgFlush() */
+
 static void _MakeWinMsgEvRec(WinMsgBufContext *, WinMsgCond *, char *, Window *, int *, int);
 
 
@@ -143,7 +184,7 @@ winmsg_esc_ex(Backtick, int id, Window *win, int *tick, struct timeval *now, int
 		return;
 
 	/* TODO: not re-entrant; static buffer returned */
-	btresult = runbacktick(bt, tick, now->tv_sec);
+	btresult = runbacktick(bt, tick, now->tv_sec, win);
 	_MakeWinMsgEvRec(wmbc, cond, btresult, win, tick, rec);
 }
 
@@ -317,34 +358,12 @@ winmsg_esc_ex(PadOrTrunc, int *numpad, int *lastpad, int padlen)
 }
 
 /**
- * Processes rendition
- *
- * The first character of SRC is assumed to be (unverified) the opening brace
- * of the sequence.
+ * Processes rendition, already parsed by WinMsgCompile()
  */
-winmsg_esc(Rend)
+winmsg_esc_ex(Rend, WinMsgOp *op)
 {
-	char rbuf[RENDBUF_SIZE];
-	uint8_t i;
-	uint64_t r;
-
-	(*src)++;
-	for (i = 0; i < (RENDBUF_SIZE-1); i++) {
-		char c = (*src)[i];
-		if (c && c != WINESC_REND_END)
-			rbuf[i] = c;
-		else
-			break;
-	}
-
-	if (((*src)[i] == WINESC_REND_END) && (wmbc->buf->numrend < MAX_WINMSG_REND)) {
-		r = 0;
-		rbuf[i] = '\0';
-		if (i != 1 || rbuf[0] != WINESC_REND_POP)
-			r = ParseAttrColor(rbuf, 0);
-		AddWinMsgRend(wmbc->buf, wmbc->p, r);
-	}
-	*src += i;
+	if (op->rendok && (wmbc->buf->numrend < MAX_WINMSG_REND))
+		AddWinMsgRend(wmbc->buf, wmbc->p, op->rend);
 }
 
 winmsg_esc(SessName)
@@ -500,6 +519,145 @@ static void _MakeWinMsgEvRec(WinMsgBufContext *wmbc, WinMsgCond *cond, char *str
 	wmb_free(tmp);
 }
 
+static void WinMsgProgFree(WinMsgProg *prog)
+{
+	free(prog->src);
+	free(prog->lit);
+	free(prog->ops);
+	free(prog);
+}
+
+static uint32_t WinMsgHash(const char *str, int chesc)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)chesc;
+
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+	return h;
+}
+
+/*
+ * Turn a format string into a list of literal runs and escapes. Runs
+ * never contain a '\0' unless they consist of nothing else.
+ */
+static WinMsgProg *WinMsgCompile(const char *str, int chesc, uint32_t hash)
+{
+	WinMsgProg *prog;
+	WinMsgOp *op, *lop = NULL;
+	size_t len = strlen(str);
+	char *s, *l, c;
+
+	if (!(prog = calloc(1, sizeof(WinMsgProg))))
+		return NULL;
+	prog->src = malloc(len + 1);
+	prog->lit = malloc(len + 1);
+	prog->ops = malloc((len + 1) * sizeof(WinMsgOp));	/* at most one per char */
+	if (!prog->src || !prog->lit || !prog->ops) {
+		WinMsgProgFree(prog);
+		return NULL;
+	}
+	memcpy(prog->src, str, len + 1);
+	prog->chesc = chesc;
+	prog->hash = hash;
+
+	l = prog->lit;
+	for (s = prog->src; *s; s++) {
+		if (*s != chesc) {
+			c = *s;
+			if ((chesc == '%') && (c == '^')) {
+				if (!*++s)
+					break;
+				if (*s == '^' || *s < 64)
+					continue;
+				c = *s & 0x1f;
+			}
+			if (!lop || !c || !*lop->s) {
+				lop = prog->ops + prog->nops++;
+				memset(lop, 0, sizeof(WinMsgOp));
+				lop->s = l;
+			}
+			*l++ = c;
+			lop->len++;
+			continue;
+		}
+		lop = NULL;
+
+		if (*++s == chesc)	/* double escape ? */
+			continue;
+
+		op = prog->ops + prog->nops++;
+		memset(op, 0, sizeof(WinMsgOp));
+		if ((op->esc.flags.plus = (*s == '+')) != 0)
+			s++;
+		if ((op->esc.flags.minus = (*s == '-')) != 0)
+			s++;
+		if ((op->esc.flags.zero = (*s == '0')) != 0)
+			s++;
+		while (*s >= '0' && *s <= '9')
+			op->esc.num = op->esc.num * 10 + (*s++ - '0');
+		if ((op->esc.flags.lng = (*s == 'L')) != 0)
+			s++;
+		if (!*s) {
+			prog->nops--;
+			break;
+		}
+		op->type = (unsigned char)*s;
+		op->s = s;
+		prog->deps[op->type / 32] |= 1u << (op->type % 32);
+		if (op->esc.flags.lng)
+			prog->deps[(op->type | 0x100) / 32] |= 1u << (op->type % 32);
+		if (op->type == WINESC_BACKTICK)
+			prog->btids |= (uint64_t)1 << (op->esc.num % 64);
+
+		if (op->type == WINESC_REND_START) {
+			char rbuf[RENDBUF_SIZE];
+			int i;
+
+			s++;
+			for (i = 0; i < (RENDBUF_SIZE - 1) && s[i] && s[i] != WINESC_REND_END; i++)
+				rbuf[i] = s[i];
+			if (s[i] == WINESC_REND_END) {
+				rbuf[i] = '\0';
+				if (i != 1 || rbuf[0] != WINESC_REND_POP)
+					op->rend = ParseAttrColor(rbuf, 0);
+				op->rendok = true;
+			}
+			s += i;
+			if (!*s)
+				break;
+		}
+	}
+	return prog;
+}
+
+/*
+ * Compiled form of str, from the cache if it was seen before. A slot
+ * that is still being evaluated is not replaced, the caller frees the
+ * uncached program when done.
+ */
+static WinMsgProg *WinMsgGetProg(const char *str, int chesc)
+{
+	uint32_t h = WinMsgHash(str, chesc);
+	WinMsgProg **pp = progcache + h % WINMSG_PROGCACHE;
+
+	if (*pp && (*pp)->hash == h && (*pp)->chesc == chesc && !strcmp((*pp)->src, str))
+		return *pp;
+	if (*pp && (*pp)->busy)
+		return WinMsgCompile(str, chesc, h);
+	if (*pp)
+		WinMsgProgFree(*pp);
+	if ((*pp = WinMsgCompile(str, chesc, h)))
+		(*pp)->cached = true;
+	return *pp;
+}
+
+/* done with a program from WinMsgGetProg() */
+static void WinMsgPutProg(WinMsgProg *prog)
+{
+	if (!prog->busy && !prog->cached)
+		WinMsgProgFree(prog);
+}
+
 /* TODO: const char *str for safety and reassurance */
 char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
                    int chesc, int padlen, Event *ev, int rec)
@@ -511,7 +669,10 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 	int lastpad = 0;
 	WinMsgBufContext *wmbc;
 	WinMsgEsc esc;
-	WinMsgCond *cond;
+	WinMsgCond wmcond, *cond = &wmcond;
+	WinMsgProg *prog;
+	WinMsgOp *op;
+	char *s;
 
 	/* TODO: temporary to work into existing code */
 	if (winmsg == NULL) {
@@ -525,10 +686,6 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 	if (rec > WINMSG_RECLIMIT)
 		return winmsg->buf;
 
-	cond = calloc(1, sizeof(WinMsgCond));
-	if (cond == NULL)
-		Panic(0, "%s", strnomem);
-
 	/* set to sane state (clear garbage) */
 	wmc_deinit(cond);
 
@@ -539,40 +696,26 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 	wmb_reset(winmsg);
 	wmbc = wmbc_create(winmsg);
 
-	if (wmbc == NULL)
+	if (wmbc == NULL || (prog = WinMsgGetProg(str, chesc)) == NULL)
 		Panic(0, "%s", strnomem);
 
+	prog->busy++;
 	tick = 0;
 	gettimeofday(&now, NULL);
-	for (char *s = str; *s; s++) {
-		if (*s != chesc) {
-			if ((chesc == '%') && (*s == '^')) {
-				s++;
-				if (*s != '^' && *s >= 64)
-					wmbc_putchar(wmbc, *s & 0x1f);
-				continue;
-			}
-			wmbc_putchar(wmbc, *s);
+	for (op = prog->ops; op < prog->ops + prog->nops; op++) {
+		if (op->type == 0) {
+			if (op->len == 1)
+				wmbc_putchar(wmbc, *op->s);
+			else
+				wmbc_strncpy(wmbc, op->s, op->len);
 			continue;
 		}
 
-		if (*++s == chesc)	/* double escape ? */
-			continue;
-
-		/* initialize escape */
-		if ((esc.flags.plus = (*s == '+')) != 0)
-			s++;
-		if ((esc.flags.minus = (*s == '-')) != 0)
-			s++;
-		if ((esc.flags.zero = (*s == '0')) != 0)
-			s++;
-		esc.num = 0;
-		while (*s >= '0' && *s <= '9')
-			esc.num = esc.num * 10 + (*s++ - '0');
-		if ((esc.flags.lng = (*s == 'L')) != 0)
-			s++;
+		/* handlers may change their copy of the escape */
+		esc = op->esc;
+		s = op->s;
 
-		switch (*s) {
+		switch (op->type) {
 		case WINESC_COND:
 			WinMsgDoEscEx(Cond, &qmnumrend);
 			break;
@@ -600,7 +743,7 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 			WinMsgDoEscEx(WinTitle, win);
 			break;
 		case WINESC_REND_START:
-			WinMsgDoEsc(Rend);
+			WinMsgDoEscEx(Rend, op);
 			break;
 		case WINESC_HOST:
 			WinMsgDoEsc(HostName);
@@ -640,6 +783,8 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 			break;
 		}
 	}
+	prog->busy--;
+	WinMsgPutProg(prog);
 	if (wmc_is_active(cond) && !wmc_is_set(cond))
 		wmbc->p = wmc_end(cond, wmbc->p, NULL) + 1;
 	wmbc_putchar(wmbc, '\0' );
@@ -663,7 +808,6 @@ char *MakeWinMsgEv(WinMsgBuf *winmsg, char *str, Window *win,
 		ev->timeout = now;
 	}
 
-	free(cond);
 	wmbc_free(wmbc);
 	return winmsg->buf;
 }
@@ -673,39 +817,124 @@ char *MakeWinMsg(char *s, Window *win, int esc)
 	return MakeWinMsgEv(NULL, s, win, esc, 0, (Event *)0, 0);
 }
 
-static int WindowChangedCheck(char *s, WinMsgEscapeChar what, int *hp)
+/* does str use the escape what (| 0x100 for long forms only)? */
+static bool WinMsgUses(char *str, int chesc, int what)
 {
-	int h = 0;
-	int l;
-	while (*s) {
-		if (*s++ != (hp ? '%' : '\005'))
-			continue;
-		l = 0;
-		s += (*s == '+');
-		s += (*s == '-');
-		while (*s >= '0' && *s <= '9')
-			s++;
-		if (*s == 'L') {
-			s++;
-			l = 0x100;
-		}
-		if (*s == WINESC_HSTATUS)
-			h = 1;
-		if (*s == what || ((*s | l) == what))
-			break;
-		if (*s)
-			s++;
+	WinMsgProg *prog;
+	bool r;
+
+	if (!(prog = WinMsgGetProg(str, chesc)))
+		return true;
+	if (what == WINESC_BACKTICK && winmsgbtid >= 0)
+		r = (prog->btids >> (winmsgbtid % 64)) & 1;
+	else
+		r = (prog->deps[what / 32] >> (what % 32)) & 1;
+	WinMsgPutProg(prog);
+	return r;
+}
+
+static void WinMsgAddDeps(char *str, int dep)
+{
+	WinMsgProg *prog;
+
+	if (!(prog = WinMsgGetProg(str, '%'))) {
+		for (int i = 0; i < 0x200; i++)
+			winmsgdeps[i] |= dep;
+		for (int i = 0; i < 64; i++)
+			winmsgbtdeps[i] |= dep;
+		return;
+	}
+	for (int i = 0; i < 0x200; i++)
+		if ((prog->deps[i / 32] >> (i % 32)) & 1)
+			winmsgdeps[i] |= dep;
+	for (int i = 0; i < 64; i++)
+		if ((prog->btids >> i) & 1)
+			winmsgbtdeps[i] |= dep;
+	WinMsgPutProg(prog);
+}
+
+/* caption, hardstatus or windowlist string was replaced */
+void WinMsgFormatChanged(void)
+{
+	winmsgdepsok = false;
+}
+
+/* surfaces using escape what, those using %h in *hp */
+static int WinMsgDeps(WinMsgEscapeChar what, int *hp)
+{
+	if (!winmsgdepsok) {
+		memset(winmsgdeps, 0, sizeof(winmsgdeps));
+		memset(winmsgbtdeps, 0, sizeof(winmsgbtdeps));
+		WinMsgAddDeps(captionstring, WINMSG_DEP_CAPTION);
+		WinMsgAddDeps(hstatusstring, WINMSG_DEP_HSTATUS);
+		WinMsgAddDeps(wliststr, WINMSG_DEP_WLIST);
+		winmsgdepsok = true;
+	}
+	*hp = winmsgdeps[WINESC_HSTATUS];
+	if (what == WINESC_BACKTICK && winmsgbtid >= 0)
+		return winmsgbtdeps[winmsgbtid % 64];
+	return winmsgdeps[what & 0x1ff];
+}
+
+/* backtick id got a new result, redraw only what shows it */
+void WinMsgBacktickChanged(int id)
+{
+	winmsgbtid = id;
+	WindowChanged((Window *)0, WINESC_BACKTICK);
+	winmsgbtid = -1;
+}
+
+/* changes that may come in bursts, their redraws wait for WinMsgFlush() */
+static bool WinMsgDeferred(WinMsgEscapeChar what)
+{
+	switch (what & 0xff) {
+	case WINESC_WIN_TITLE:
+	case WINESC_WIN_NAMES:
+	case WINESC_WIN_NAMES_NOCUR:
+	case WINESC_WFLAGS:
+	case WINESC_BACKTICK:
+	case WINESC_HSTATUS:
+		return true;
+	default:
+		return false;
 	}
-	if (hp)
-		*hp = h;
-	return *s ? 1 : 0;
+}
+
+static void RefreshCaption(Canvas *cv)
+{
+	if (captiontop) {
+		if (cv->c_ys - 1 >= 0)
+			RefreshLine(cv->c_ys - 1, 0, D_width - 1, 0);
+	} else {
+		if (cv->c_ye + 1 < D_height)
+			RefreshLine(cv->c_ye + 1, 0, D_width - 1, 0);
+	}
+}
+
+/* redraw surface dep of cv on the current display now, or mark it */
+static void WinMsgRedraw(Canvas *cv, int dep, Window *win, bool defer)
+{
+	if (defer) {
+		if (dep == WINMSG_DEP_HSTATUS)
+			D_msgdirty |= dep;
+		else
+			cv->c_msgdirty |= dep;
+		winmsgdirty = true;
+	} else if (dep == WINMSG_DEP_CAPTION)
+		RefreshCaption(cv);
+	else if (dep == WINMSG_DEP_HSTATUS)
+		RefreshHStatus();
+	else
+		WListUpdatecv(cv, win);
 }
 
 void WindowChanged(Window *win, WinMsgEscapeChar what)
 {
 	int inwstr, inhstr, inlstr;
 	int inwstrh = 0, inhstrh = 0, inlstrh = 0;
+	int deps, hdeps;
 	int got, ox, oy;
+	bool defer = WinMsgDeferred(what);
 	Display *olddisplay = display;
 	Canvas *cv;
 
@@ -715,9 +944,13 @@ void WindowChanged(Window *win, WinMsgEscapeChar what)
 	}
 
 	if (what) {
-		inwstr = WindowChangedCheck(captionstring, what, &inwstrh);
-		inhstr = WindowChangedCheck(hstatusstring, what, &inhstrh);
-		inlstr = WindowChangedCheck(wliststr, what, &inlstrh);
+		deps = WinMsgDeps(what, &hdeps);
+		inwstr = deps & WINMSG_DEP_CAPTION;
+		inhstr = deps & WINMSG_DEP_HSTATUS;
+		inlstr = deps & WINMSG_DEP_WLIST;
+		inwstrh = hdeps & WINMSG_DEP_CAPTION;
+		inhstrh = hdeps & WINMSG_DEP_HSTATUS;
+		inlstrh = hdeps & WINMSG_DEP_WLIST;
 	} else {
 		inwstr = inhstr = 0;
 		inlstr = 1;
@@ -730,26 +963,19 @@ void WindowChanged(Window *win, WinMsgEscapeChar what)
 			for (cv = D_cvlist; cv; cv = cv->c_next) {
 				if (inlstr
 				    || (inlstrh && win && win->w_hstatus && *win->w_hstatus
-					&& WindowChangedCheck(win->w_hstatus, what, (int *)0)))
-					WListUpdatecv(cv, (Window *)0);
+					&& WinMsgUses(win->w_hstatus, WINMSG_BT_ESC, what)))
+					WinMsgRedraw(cv, WINMSG_DEP_WLIST, (Window *)0, defer);
 				win = Layer2Window(cv->c_layer);
 				if (inwstr
 				    || (inwstrh && win && win->w_hstatus && *win->w_hstatus
-					&& WindowChangedCheck(win->w_hstatus, what, (int *)0))) {
-					if (captiontop) {
-						if (cv->c_ys - 1 >= 0)
-							RefreshLine(cv->c_ys - 1, 0, D_width -1 , 0);
-					} else {
-						if (cv->c_ye + 1 < D_height)
-							RefreshLine(cv->c_ye + 1, 0, D_width - 1, 0);
-					}
-				}
+					&& WinMsgUses(win->w_hstatus, WINMSG_BT_ESC, what)))
+					WinMsgRedraw(cv, WINMSG_DEP_CAPTION, win, defer);
 			}
 			win = D_fore;
 			if (inhstr
 			    || (inhstrh && win && win->w_hstatus && *win->w_hstatus
-				&& WindowChangedCheck(win->w_hstatus, what, (int *)0)))
-				RefreshHStatus();
+				&& WinMsgUses(win->w_hstatus, WINMSG_BT_ESC, what)))
+				WinMsgRedraw((Canvas *)0, WINMSG_DEP_HSTATUS, win, defer);
 			if (ox != -1 && oy != -1)
 				GotoPos(ox, oy);
 		}
@@ -758,7 +984,7 @@ void WindowChanged(Window *win, WinMsgEscapeChar what)
 	}
 
 	if (win->w_hstatus && *win->w_hstatus && (inwstrh || inhstrh || inlstrh)
-	    && WindowChangedCheck(win->w_hstatus, what, (int *)0)) {
+	    && WinMsgUses(win->w_hstatus, WINMSG_BT_ESC, what)) {
 		inwstr |= inwstrh;
 		inhstr |= inhstrh;
 		inlstr |= inlstrh;
@@ -771,22 +997,47 @@ void WindowChanged(Window *win, WinMsgEscapeChar what)
 		oy = D_y;
 		for (cv = D_cvlist; cv; cv = cv->c_next) {
 			if (inlstr)
-				WListUpdatecv(cv, win);
+				WinMsgRedraw(cv, WINMSG_DEP_WLIST, defer ? (Window *)0 : win, defer);
 			if (Layer2Window(cv->c_layer) != win)
 				continue;
 			got = 1;
-			if (inwstr) {
-				if (captiontop) {
-					if (cv->c_ys -1 >= 0)
-						RefreshLine(cv->c_ys - 1, 0, D_width - 1, 0);
-				} else {
-					if (cv->c_ye + 1 < D_height)
-						RefreshLine(cv->c_ye + 1, 0, D_width - 1, 0);
-				}
-			}
+			if (inwstr)
+				WinMsgRedraw(cv, WINMSG_DEP_CAPTION, win, defer);
 		}
 		if (got && inhstr && win == D_fore)
+			WinMsgRedraw((Canvas *)0, WINMSG_DEP_HSTATUS, win, defer);
+		if (ox != -1 && oy != -1)
+			GotoPos(ox, oy);
+	}
+	display = olddisplay;
+}
+
+/*
+ * Redraw the surfaces marked by WindowChanged() since the last call,
+ * each one once. Called from the main loop before it sleeps.
+ */
+void WinMsgFlush(void)
+{
+	Display *olddisplay = display;
+	Canvas *cv;
+	int ox, oy;
+
+	if (!winmsgdirty)
+		return;
+	winmsgdirty = false;
+	for (display = displays; display; display = display->d_next) {
+		ox = D_x;
+		oy = D_y;
+		for (cv = D_cvlist; cv; cv = cv->c_next) {
+			if (cv->c_msgdirty & WINMSG_DEP_WLIST)
+				WListUpdatecv(cv, (Window *)0);
+			if (cv->c_msgdirty & WINMSG_DEP_CAPTION)
+				RefreshCaption(cv);
+			cv->c_msgdirty = 0;
+		}
+		if (D_msgdirty & WINMSG_DEP_HSTATUS)
 			RefreshHStatus();
+		D_msgdirty = 0;
 		if (ox != -1 && oy != -1)
 			GotoPos(ox, oy);
 	}
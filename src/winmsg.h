@@ -88,6 +88,9 @@ char *MakeWinMsg(char *, Window *, int);
 char *MakeWinMsgEv(WinMsgBuf *, char *, Window *, int, int, Event *, int);
 int   AddWinMsgRend(WinMsgBuf *, const char *, uint64_t);
 void  WindowChanged (Window *, WinMsgEscapeChar);
+void  WinMsgFormatChanged (void);
+void  WinMsgBacktickChanged (int);
+void  WinMsgFlush (void);
 
 extern WinMsgBuf *g_winmsg;
 